@@ -0,0 +1,155 @@
+#define _GNU_SOURCE
+
+
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "../lib/frontier.h"
+
+
+// gcc -O2 -std=gnu99 -pthread -o frontier_bench bench/frontier_bench.c lib/frontier.c lib/url.c -lm
+// ./frontier_bench [urls] [threads]
+//
+// Pops every url once per batch size, as workers filling that many transfer
+// slots would, and gives each connection back right away. Exits with 1 if a
+// url is popped twice or never.
+
+
+#define	DEFAULT_URLS	1000000
+#define	DEFAULT_THREADS	4
+#define	NUM_HOSTS		1000
+#define	MAX_BATCH		64
+
+
+static const size_t batches[] = { 1, 8, 64 };
+
+
+typedef struct job {
+	frontier_t * frontier;
+	size_t batch;
+	unsigned char * seen;
+	long * left;		/* urls not popped yet, shared by the jobs */
+	size_t popped;
+	size_t twice;
+} job_t;
+
+
+int num_urls;
+
+
+static double
+now(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+
+/* urls queued by id, the id is the url's number */
+static frontier_t *
+fill(void)
+{
+	frontier_t * frontier = frontier_create((size_t)num_urls * 64, NULL, MAX_BATCH, 1e9);
+	char str[128];
+	url_t * url;
+	float score;
+	int length;
+
+	for (uint32_t i = 0; i < (uint32_t)num_urls; i++) {
+		length = snprintf(str, sizeof(str), "https://host-%u.example.com/page-%u.html", i % NUM_HOSTS, i);
+		url = url_create(str, length);
+		score = (i % 7) / 6.0f;
+		if (!url || frontier_push(frontier, &url, &i, &score, 1) != 1)
+			exit(1);
+		url_free(url);
+	}
+
+	return frontier;
+}
+
+
+static void *
+drain(void * data)
+{
+	job_t * job = (job_t *)data;
+	frontier_url_t next[MAX_BATCH];
+	host_t * hosts[MAX_BATCH];
+	size_t count;
+	int wait;
+
+	while (__atomic_load_n(job->left, __ATOMIC_RELAXED) > 0) {
+		count = frontier_pop(job->frontier, next, hosts, job->batch, &wait);
+		__atomic_sub_fetch(job->left, count, __ATOMIC_RELAXED);
+		for (size_t i = 0; i < count; i++) {
+			job->twice += __atomic_fetch_add(&job->seen[next[i].id], 1, __ATOMIC_RELAXED) != 0;
+			frontier_done(job->frontier, hosts[i], 200, 0.001);
+		}
+		job->popped += count;
+	}
+
+	return NULL;
+}
+
+
+static double
+run(size_t batch, int num_threads, bool * ok)
+{
+	frontier_t * frontier = fill();
+	unsigned char * seen = calloc(num_urls, 1);
+	pthread_t threads[num_threads];
+	job_t jobs[num_threads];
+	size_t popped = 0, twice = 0;
+	long left = num_urls;
+	double start = now();
+
+	for (int t = 0; t < num_threads; t++) {
+		jobs[t] = (job_t){ frontier, batch, seen, &left, 0, 0 };
+		pthread_create(&threads[t], NULL, drain, &jobs[t]);
+	}
+	for (int t = 0; t < num_threads; t++) {
+		pthread_join(threads[t], NULL);
+		popped += jobs[t].popped;
+		twice += jobs[t].twice;
+	}
+	start = now() - start;
+
+	*ok = popped == (size_t)num_urls && twice == 0;
+	if (!*ok)
+		printf("(%zu popped, %zu twice!) ", popped, twice);
+
+	frontier_destroy(frontier);
+	free(seen);
+
+	return num_urls / start;
+}
+
+
+int
+main(int argc, char * argv[])
+{
+	int num_threads = DEFAULT_THREADS, failed = 0;
+	bool ok;
+
+	num_urls = argc > 1 ? atoi(argv[1]) : DEFAULT_URLS;
+	if (argc > 2)
+		num_threads = atoi(argv[2]);
+	if (num_urls < 1 || num_threads < 1) {
+		fprintf(stderr, "Usage: %s [urls] [threads]\n", argv[0]);
+		return 1;
+	}
+
+	printf("%d urls on %d hosts, %d threads\n\n", num_urls, NUM_HOSTS, num_threads);
+	printf("%-8s %10s\n", "batch", "Murls/s");
+
+	for (size_t b = 0; b < sizeof(batches) / sizeof(batches[0]); b++) {
+		printf("%-8zu %10.2f\n", batches[b], run(batches[b], num_threads, &ok) / 1e6);
+		failed |= !ok;
+	}
+
+	return failed;
+}
@@ -0,0 +1,263 @@
+#define _GNU_SOURCE
+
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "../htmlparser.h"
+#include "../htmlscan.h"
+
+
+// gcc -O2 -std=gnu99 -pthread -o htmlscan_bench bench/htmlscan_bench.c htmlparser.c htmlscan.c lib/*.c -lm
+// ./htmlscan_bench [html file] [rounds]
+//
+// Checks every SIMD classifier the CPU supports against the scalar one, on
+// random blocks and through the parser, then times the parser with each.
+// Exits with 1 on the first difference.
+
+
+#define	RANDOM_BLOCKS	1000000
+#define	DEFAULT_ROUNDS	20
+#define	CHUNK			97		/* odd, so blocks and runs straddle chunks */
+
+
+static const char * level_names[] = { "scalar", "sse2", "avx2", "avx512" };
+
+
+/* what the parser reports for a document, to compare between levels */
+typedef struct parse {
+	span_vector_t spans;	/* offsets into the whole document */
+	text_results_t links;
+} parse_t;
+
+
+static double
+now(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+
+static char *
+read_file(const char * path, size_t * length)
+{
+	FILE * file = fopen(path, "r");
+	char * data;
+	long size;
+
+	if (!file || fseek(file, 0, SEEK_END) || (size = ftell(file)) < 0 || fseek(file, 0, SEEK_SET)) {
+		perror(path);
+		exit(1);
+	}
+
+	data = malloc(size + 1);
+	if (!data || fread(data, 1, size, file) != (size_t)size) {
+		perror(path);
+		exit(1);
+	}
+	fclose(file);
+
+	*length = size;
+	return data;
+}
+
+
+/* markup with every class of byte, nested oddly and with long runs */
+static char *
+make_html(size_t * length)
+{
+	static const char * pieces[] = {
+		"<a href=\"/page-%d.html\">anchor %d</a>", "<img src='/img/%d.png' alt=x%d>",
+		"<!-- comment %d -- - --->", "<p class = \"c%d\">text\t\r\f%d</p>\n", "<a href=/bare%d>x%d<a href=\"\">",
+		"   \n\n  words %d and more words %d  ", "<div data-x=\"a=b>c\" id='%d'>%d", "<!--%d-->-->%d<!-",
+		"<br/><A HREF=\"/Upper%d\">%d</A>", "<script>if (a<b && c>d) x = %d;</script>%d"
+	};
+	size_t capacity = 1 << 22, used = 0;
+	char * html = malloc(capacity);
+
+	srand(1);
+	while (used < capacity - 256)
+		used += snprintf(html + used, capacity - used, pieces[rand() % 10], rand() % 1000, rand() % 1000);
+
+	*length = used;
+	return html;
+}
+
+
+static bool
+same_masks(scan_masks_t * a, scan_masks_t * b)
+{
+	return a->lt == b->lt && a->gt == b->gt && a->eq == b->eq && a->space == b->space &&
+		a->dquote == b->dquote && a->squote == b->squote && a->dash == b->dash;
+}
+
+
+/* random blocks drawn mostly from the bytes the classes look for */
+static bool
+check_blocks(scan_level_t level)
+{
+	static const char special[] = "<>=\"'- \n\t\r\f\v\0a\x80\xff";
+	char block[SCAN_BLOCK];
+	scan_masks_t scalar, simd;
+
+	srand(2);
+	for (int n = 0; n < RANDOM_BLOCKS; n++) {
+		for (int i = 0; i < SCAN_BLOCK; i++)
+			block[i] = rand() % 4 ? special[rand() % (sizeof(special) - 1)] : (char)rand();
+
+		html_scan_set_level(SCAN_SCALAR);
+		html_classify(block, &scalar);
+		html_scan_set_level(level);
+		html_classify(block, &simd);
+
+		if (!same_masks(&scalar, &simd)) {
+			fprintf(stderr, "%s: block %d classified differently from scalar\n", level_names[level], n);
+			return false;
+		}
+	}
+
+	return true;
+}
+
+
+/* feeds the document in chunks, as a transfer would */
+static void
+parse(char * html, size_t length, parse_t * result)
+{
+	html_parser_t parser;
+	span_vector_t spans;
+	text_span_t * span;
+	size_t n;
+
+	span_vector_init(&spans);
+	span_vector_init(&result->spans);
+	result->links.head = result->links.tail = NULL;
+	html_parser_init(&parser, collect_link, &result->links);
+
+	for (size_t offset = 0; offset < length; offset += n) {
+		n = length - offset < CHUNK ? length - offset : CHUNK;
+		html_parser_feed(&parser, html + offset, n, &spans);
+
+		for (size_t i = 0; i < spans.length; i++) {
+			if (result->spans.length == result->spans.capacity) {
+				result->spans.capacity = result->spans.capacity ? 2 * result->spans.capacity : 1024;
+				result->spans.spans = realloc(result->spans.spans, result->spans.capacity * sizeof(text_span_t));
+			}
+			span = &result->spans.spans[result->spans.length++];
+			*span = spans.spans[i];
+			span->offset += offset;
+		}
+	}
+
+	html_parser_finish(&parser);
+	span_vector_free(&spans);
+}
+
+
+static bool
+same_string(const char * a, const char * b)
+{
+	return a == b || (a && b && !strcmp(a, b));
+}
+
+
+static bool
+same_parse(parse_t * a, parse_t * b)
+{
+	text_result_t * x, * y;
+
+	if (a->spans.length != b->spans.length)
+		return false;
+	for (size_t i = 0; i < a->spans.length; i++)
+		if (a->spans.spans[i].offset != b->spans.spans[i].offset ||
+				a->spans.spans[i].length != b->spans.spans[i].length || a->spans.spans[i].end != b->spans.spans[i].end)
+			return false;
+
+	for (x = a->links.head, y = b->links.head; x && y; x = x->next, y = y->next)
+		if (!same_string(x->text, y->text) || !same_string(x->anchor, y->anchor))
+			return false;
+
+	return !x && !y;
+}
+
+
+static void
+free_parse(parse_t * result)
+{
+	span_vector_free(&result->spans);
+	free_text_results(result->links.head);
+}
+
+
+static double
+throughput(char * html, size_t length, int rounds)
+{
+	span_vector_t spans;
+	text_result_t * links;
+	double start = now();
+
+	span_vector_init(&spans);
+	for (int r = 0; r < rounds; r++) {
+		find_text(html, length, &spans, &links);
+		free_text_results(links);
+	}
+	span_vector_free(&spans);
+
+	return (double)length * rounds / (now() - start);
+}
+
+
+int
+main(int argc, char * argv[])
+{
+	int rounds = DEFAULT_ROUNDS, failed = 0;
+	scan_level_t best = html_scan_level();
+	parse_t reference, result;
+	size_t length;
+	char * html;
+
+	html = argc > 1 ? read_file(argv[1], &length) : make_html(&length);
+	if (argc > 2)
+		rounds = atoi(argv[2]);
+	if (rounds < 1) {
+		fprintf(stderr, "Usage: %s [html file] [rounds]\n", argv[0]);
+		return 1;
+	}
+
+	html_scan_set_level(SCAN_SCALAR);
+	parse(html, length, &reference);
+
+	printf("%zu bytes, %zu text spans, best level %s\n\n", length, reference.spans.length, level_names[best]);
+	printf("%-8s %10s %10s %10s\n", "level", "blocks", "parser", "MB/s");
+
+	for (int level = SCAN_SCALAR; level <= SCAN_AVX512; level++) {
+		bool blocks = true, parser;
+
+		if (!html_scan_set_level(level)) {
+			printf("%-8s %10s\n", level_names[level], "unsupported");
+			continue;
+		}
+
+		if (level != SCAN_SCALAR)
+			blocks = check_blocks(level);
+
+		html_scan_set_level(level);
+		parse(html, length, &result);
+		parser = same_parse(&reference, &result);
+		free_parse(&result);
+
+		printf("%-8s %10s %10s %10.0f\n", level_names[level], blocks ? "ok" : "DIFFER", parser ? "ok" : "DIFFER",
+				throughput(html, length, rounds) / 1e6);
+		failed |= !blocks || !parser;
+	}
+
+	free_parse(&reference);
+	free(html);
+
+	return failed;
+}
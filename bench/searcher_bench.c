@@ -0,0 +1,205 @@
+#define _GNU_SOURCE
+
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "../lib/searcher.h"
+
+
+// gcc -O2 -std=gnu99 -o searcher_bench bench/searcher_bench.c lib/searcher.c
+// ./searcher_bench [text file] [pattern] [rounds]
+
+
+#define	TEXT_SIZE		(64 << 10)	/* a large page */
+#define	DEFAULT_PATTERN	"treasure map"
+#define	DEFAULT_ROUNDS	2000
+
+
+static const char * words[] = {
+	"the", "of", "and", "to", "in", "is", "that", "for", "it", "as", "was", "with", "be", "by", "on",
+	"not", "he", "this", "are", "or", "his", "from", "at", "which", "but", "have", "an", "had", "they",
+	"you", "were", "their", "one", "all", "we", "can", "her", "has", "there", "been", "if", "more",
+	"when", "will", "would", "who", "so", "no", "treasure", "map", "Treasure", "island", "trees"
+};
+
+
+char * text;
+size_t length;
+
+
+static double
+now(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+
+static void
+read_text(const char * path)
+{
+	FILE * file = fopen(path, "r");
+	long size;
+
+	if (!file || fseek(file, 0, SEEK_END) || (size = ftell(file)) < 0 || fseek(file, 0, SEEK_SET)) {
+		perror(path);
+		exit(1);
+	}
+
+	text = malloc(size + 1);
+	if (!text || fread(text, 1, size, file) != (size_t)size) {
+		perror(path);
+		exit(1);
+	}
+	fclose(file);
+
+	// strstr and strcasestr stop at the first NUL
+	for (long i = 0; i < size; i++)
+		if (!text[i])
+			text[i] = ' ';
+	text[size] = '\0';
+	length = size;
+}
+
+
+/* English-like words, with the words of the default pattern but never the pattern itself */
+static void
+make_text(void)
+{
+	const char * word, * previous = "";
+
+	text = malloc(TEXT_SIZE + 1);
+	srand(1);
+
+	while (length < TEXT_SIZE - 16) {
+		word = words[rand() % (sizeof(words) / sizeof(words[0]))];
+		if (!strcmp(word, "map") && !strcasecmp(previous, "treasure"))
+			continue;
+
+		length += sprintf(text + length, "%s ", word);
+		previous = word;
+	}
+	text[length] = '\0';
+}
+
+
+typedef ssize_t (*find_function)(const char *, size_t, const char *, size_t, const searcher_t *);
+
+
+static ssize_t
+find_searcher(const char * haystack, size_t n, const char * needle, size_t m, const searcher_t * searcher)
+{
+	(void)needle;
+	(void)m;
+
+	return searcher_find(searcher, haystack, n);
+}
+
+
+static ssize_t
+find_memmem(const char * haystack, size_t n, const char * needle, size_t m, const searcher_t * searcher)
+{
+	const char * p = memmem(haystack, n, needle, m);
+
+	(void)searcher;
+
+	return p ? p - haystack : -1;
+}
+
+
+static ssize_t
+find_strstr(const char * haystack, size_t n, const char * needle, size_t m, const searcher_t * searcher)
+{
+	const char * p = strstr(haystack, needle);
+
+	(void)n;
+	(void)m;
+	(void)searcher;
+
+	return p ? p - haystack : -1;
+}
+
+
+static ssize_t
+find_strcasestr(const char * haystack, size_t n, const char * needle, size_t m, const searcher_t * searcher)
+{
+	const char * p = strcasestr(haystack, needle);
+
+	(void)n;
+	(void)m;
+	(void)searcher;
+
+	return p ? p - haystack : -1;
+}
+
+
+/* bytes searched per second, and the offset found */
+static double
+throughput(find_function find, const char * pattern, const searcher_t * searcher, int rounds, ssize_t * found)
+{
+	size_t m = strlen(pattern);
+	volatile ssize_t sink = 0;
+	double start = now();
+
+	for (int r = 0; r < rounds; r++)
+		sink += find(text, length, pattern, m, searcher);
+
+	*found = find(text, length, pattern, m, searcher);
+	(void)sink;
+
+	return (double)length * rounds / (now() - start);
+}
+
+
+static int
+compare(const char * name, find_function reference, const char * reference_name, const char * pattern,
+		int flags, int rounds)
+{
+	searcher_t * searcher = searcher_create(pattern, flags);
+	ssize_t ours, theirs;
+	double fast, slow;
+
+	fast = throughput(find_searcher, pattern, searcher, rounds, &ours);
+	slow = throughput(reference, pattern, NULL, rounds, &theirs);
+	searcher_destroy(searcher);
+
+	printf("%-14s %10.0f  %-10s %10.0f  %6.1fx", name, fast / 1e6, reference_name, slow / 1e6, fast / slow);
+	if (ours != theirs)
+		printf("  found at %zd, %s at %zd!", ours, reference_name, theirs);
+	printf("\n");
+
+	return ours != theirs;
+}
+
+
+int
+main(int argc, char * argv[])
+{
+	const char * pattern = argc > 2 ? argv[2] : DEFAULT_PATTERN;
+	int rounds = argc > 3 ? atoi(argv[3]) : DEFAULT_ROUNDS, failed = 0;
+
+	if (argc > 1 && strcmp(argv[1], "-"))
+		read_text(argv[1]);
+	else
+		make_text();
+	if (rounds < 1 || !*pattern) {
+		fprintf(stderr, "Usage: %s [text file|-] [pattern] [rounds]\n", argv[0]);
+		return 1;
+	}
+
+	printf("%zu bytes of text, pattern \"%s\"\n\n", length, pattern);
+	printf("%-14s %10s  %-10s %10s\n", "", "MB/s", "", "MB/s");
+
+	failed |= compare("searcher", find_memmem, "memmem", pattern, 0, rounds);
+	failed |= compare("searcher", find_strstr, "strstr", pattern, 0, rounds);
+	failed |= compare("searcher -i", find_strcasestr, "strcasestr", pattern, SEARCH_IGNORE_CASE, rounds);
+
+	free(text);
+
+	return failed;
+}
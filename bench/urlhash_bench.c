@@ -0,0 +1,312 @@
+#define _GNU_SOURCE
+
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "../lib/hash.h"
+#include "../lib/url.h"
+#include "../lib/visited.h"
+
+
+// gcc -O2 -std=gnu99 -pthread -o urlhash_bench bench/urlhash_bench.c lib/url.c lib/visited.c lib/bloom.c -lm
+// ./urlhash_bench [file with one url per line] [rounds]
+
+
+#define	DEFAULT_ELEMENTS	100000
+#define	DEFAULT_ROUNDS		20
+#define	LOOKUPS				4	/* a crawled url is looked up by contains and claimed */
+
+
+typedef uint64_t (*hash_function)(const char *, size_t);
+
+
+static uint64_t
+djb2(const char * str, size_t length)
+{
+	unsigned long hash = 5381;
+
+	for (size_t i = 0; i < length; i++)
+		hash = ((hash << 5) + hash) + (unsigned char)str[i];
+
+	return hash;
+}
+
+
+static uint64_t
+fnv1a(const char * str, size_t length)
+{
+	uint64_t hash = 0xcbf29ce484222325ULL;
+
+	for (size_t i = 0; i < length; i++) {
+		hash ^= (unsigned char)str[i];
+		hash *= 0x100000001b3ULL;
+	}
+
+	return hash;
+}
+
+
+static uint64_t
+wyhash(const char * str, size_t length)
+{
+	return hash_bytes(str, length, 0);
+}
+
+
+static const struct {
+	const char * name;
+	hash_function hash;
+} hashes[] = {
+	{ "djb2", djb2 },
+	{ "fnv1a", fnv1a },
+	{ "wyhash", wyhash }
+};
+
+
+/* bucket counts of the tables the crawler had and has, prime and power of two */
+static const size_t buckets[] = { 1013, 1024, 65536 };
+
+
+int num_elements;
+char * * keys;
+size_t * lengths;
+
+
+static double
+now(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+
+static void
+read_keys(const char * path)
+{
+	FILE * file = fopen(path, "r");
+	char * line = NULL;
+	size_t size = 0, capacity = 1024;
+	ssize_t length;
+
+	if (!file) {
+		perror("Error");
+		exit(1);
+	}
+
+	keys = malloc(capacity * sizeof(char *));
+	while ((length = getline(&line, &size, file)) != -1) {
+		if (length > 0 && line[length - 1] == '\n')
+			line[--length] = '\0';
+		if (length == 0)
+			continue;
+
+		if (num_elements == (int)capacity)
+			keys = realloc(keys, (capacity *= 2) * sizeof(char *));
+		keys[num_elements++] = strdup(line);
+	}
+
+	free(line);
+	fclose(file);
+}
+
+
+/* url-like keys, the same shape as the crawler's */
+static void
+make_keys(int count)
+{
+	keys = malloc(count * sizeof(char *));
+
+	for (int i = 0; i < count; i++)
+		if (asprintf(&keys[i], "https://www.example.com/articles/%d/page-%x.html", i % 997, i) < 0)
+			exit(1);
+
+	num_elements = count;
+}
+
+
+/*
+ * Sum over the buckets of n(n + 1) / 2, the probes to find every key, over
+ * what a uniformly random hash would need. Close to 1.0 is as good as random.
+ */
+static double
+distribution(hash_function hash, size_t num_buckets, size_t * max)
+{
+	size_t * counts = calloc(num_buckets, sizeof(size_t));
+	double probes = 0, n = num_elements, m = num_buckets;
+
+	for (int i = 0; i < num_elements; i++)
+		counts[hash(keys[i], lengths[i]) % num_buckets]++;
+
+	*max = 0;
+	for (size_t b = 0; b < num_buckets; b++) {
+		probes += counts[b] * (counts[b] + 1) / 2.0;
+		if (counts[b] > *max)
+			*max = counts[b];
+	}
+
+	free(counts);
+
+	return probes / ((n / (2 * m)) * (n + 2 * m - 1));
+}
+
+
+static int
+compare_u64(const void * a, const void * b)
+{
+	uint64_t x = *(const uint64_t *)a, y = *(const uint64_t *)b;
+
+	return (x > y) - (x < y);
+}
+
+
+/* keys sharing a full 64-bit hash, what the fingerprint visited set relies on */
+static int
+collisions(hash_function hash)
+{
+	uint64_t * values = malloc(num_elements * sizeof(uint64_t));
+	int count = 0;
+
+	for (int i = 0; i < num_elements; i++)
+		values[i] = hash(keys[i], lengths[i]);
+
+	qsort(values, num_elements, sizeof(uint64_t), compare_u64);
+	for (int i = 1; i < num_elements; i++)
+		count += values[i] == values[i - 1];
+
+	free(values);
+
+	return count;
+}
+
+
+static double
+throughput(hash_function hash, int rounds)
+{
+	volatile uint64_t sink = 0;
+	double start = now();
+
+	for (int r = 0; r < rounds; r++)
+		for (int i = 0; i < num_elements; i++)
+			sink += hash(keys[i], lengths[i]);
+
+	(void)sink;
+
+	return (double)num_elements * rounds / (now() - start);
+}
+
+
+/* as the crawler was: every lookup hashes the string again */
+static double
+table_strings(int rounds)
+{
+	double start = now();
+	long found = 0;
+
+	for (int r = 0; r < rounds; r++) {
+		visited_t * set = visited_create(num_elements, VISITED_FP_RATE, 0);
+
+		for (int i = 0; i < num_elements; i++)
+			visited_insert_if_absent(set, djb2(keys[i], strlen(keys[i])));
+		for (int l = 0; l < LOOKUPS; l++)
+			for (int i = 0; i < num_elements; i++)
+				found += visited_contains(set, djb2(keys[i], strlen(keys[i])));
+
+		visited_destroy(set);
+	}
+
+	if (found != (long)num_elements * LOOKUPS * rounds)
+		printf("(%ld found!) ", found);
+
+	return (double)num_elements * (LOOKUPS + 1) * rounds / (now() - start);
+}
+
+
+/* urls hashed once when they are created, included in the time */
+static double
+table_urls(int rounds)
+{
+	double start = now();
+	long found = 0;
+
+	for (int r = 0; r < rounds; r++) {
+		visited_t * set = visited_create(num_elements, VISITED_FP_RATE, 0);
+		url_t * * urls = malloc(num_elements * sizeof(url_t *));
+
+		for (int i = 0; i < num_elements; i++) {
+			urls[i] = url_create(keys[i], lengths[i]);
+			visited_insert_if_absent(set, urls[i]->hash);
+		}
+		for (int l = 0; l < LOOKUPS; l++)
+			for (int i = 0; i < num_elements; i++)
+				found += visited_contains(set, urls[i]->hash);
+
+		visited_destroy(set);
+		for (int i = 0; i < num_elements; i++)
+			url_free(urls[i]);
+		free(urls);
+	}
+
+	if (found != (long)num_elements * LOOKUPS * rounds)
+		printf("(%ld found!) ", found);
+
+	return (double)num_elements * (LOOKUPS + 1) * rounds / (now() - start);
+}
+
+
+int
+main(int argc, char * argv[])
+{
+	int rounds = DEFAULT_ROUNDS;
+	size_t bytes = 0, max;
+	double rate, probes;
+
+	if (argc > 1)
+		read_keys(argv[1]);
+	else
+		make_keys(DEFAULT_ELEMENTS);
+	if (argc > 2)
+		rounds = atoi(argv[2]);
+	if (num_elements < 1 || rounds < 1) {
+		fprintf(stderr, "Usage: %s [file with one url per line] [rounds]\n", argv[0]);
+		return 1;
+	}
+
+	lengths = malloc(num_elements * sizeof(size_t));
+	for (int i = 0; i < num_elements; i++)
+		bytes += lengths[i] = strlen(keys[i]);
+
+	printf("%d urls, %.1f bytes on average\n\n", num_elements, (double)bytes / num_elements);
+
+	printf("%-8s %10s %10s", "hash", "Mhash/s", "GB/s");
+	for (size_t b = 0; b < sizeof(buckets) / sizeof(buckets[0]); b++)
+		printf("  %8zu: probes  max", buckets[b]);
+	printf("  64-bit collisions\n");
+
+	for (size_t h = 0; h < sizeof(hashes) / sizeof(hashes[0]); h++) {
+		rate = throughput(hashes[h].hash, rounds);
+		printf("%-8s %10.1f %10.2f", hashes[h].name, rate / 1e6, rate * bytes / num_elements / 1e9);
+
+		for (size_t b = 0; b < sizeof(buckets) / sizeof(buckets[0]); b++) {
+			probes = distribution(hashes[h].hash, buckets[b], &max);
+			printf("  %16.3f %5zu", probes, max);
+		}
+
+		printf("  %18d\n", collisions(hashes[h].hash));
+	}
+
+	printf("\nvisited set, insert and %d lookups per url, Mops/s\n", LOOKUPS);
+	printf("%-24s %10.2f\n", "strings, djb2 each time", table_strings(rounds) / 1e6);
+	printf("%-24s %10.2f\n", "url_t, wyhash once", table_urls(rounds) / 1e6);
+
+	for (int i = 0; i < num_elements; i++)
+		free(keys[i]);
+	free(keys);
+	free(lengths);
+
+	return 0;
+}
@@ -0,0 +1,191 @@
+#define _GNU_SOURCE
+
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "../lib/arena.h"
+#include "../lib/url.h"
+#include "../lib/urlstore.h"
+
+
+// gcc -O2 -std=gnu99 -pthread -o urlstore_bench bench/urlstore_bench.c lib/urlstore.c lib/arena.c lib/url.c
+// ./urlstore_bench [file with one url per line] [rounds]
+
+
+#define	DEFAULT_ELEMENTS	100000
+#define	DEFAULT_ROUNDS		5
+#define	TABLE_SLOT			(sizeof(url_t *) * 2)	/* a pointer per slot, the table half full on average */
+
+
+int num_elements;
+char * * keys;
+size_t * lengths;
+
+
+static double
+now(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+
+static void
+read_keys(const char * path)
+{
+	FILE * file = fopen(path, "r");
+	char * line = NULL;
+	size_t size = 0, capacity = 1024;
+	ssize_t length;
+
+	if (!file) {
+		perror("Error");
+		exit(1);
+	}
+
+	keys = malloc(capacity * sizeof(char *));
+	while ((length = getline(&line, &size, file)) != -1) {
+		if (length > 0 && line[length - 1] == '\n')
+			line[--length] = '\0';
+		if (length == 0 || length > URL_STORE_MAX)
+			continue;
+
+		if (num_elements == (int)capacity)
+			keys = realloc(keys, (capacity *= 2) * sizeof(char *));
+		keys[num_elements++] = strdup(line);
+	}
+
+	free(line);
+	fclose(file);
+}
+
+
+/* url-like keys, the same shape as the crawler's */
+static void
+make_keys(int count)
+{
+	keys = malloc(count * sizeof(char *));
+
+	for (int i = 0; i < count; i++)
+		if (asprintf(&keys[i], "https://www.example.com/articles/%d/page-%x.html", i % 997, i) < 0)
+			exit(1);
+
+	num_elements = count;
+}
+
+
+/* the url table as it was: a url_t in the arena and a slot for each url */
+static size_t
+arena_bytes(void)
+{
+	size_t bytes = 0;
+
+	for (int i = 0; i < num_elements; i++)
+		bytes += ((url_size(lengths[i]) + ARENA_ALIGN - 1) & ~(size_t)(ARENA_ALIGN - 1)) + TABLE_SLOT;
+
+	return bytes;
+}
+
+
+static url_store_t *
+fill(uint32_t * ids, double * rate)
+{
+	url_store_t * store = url_store_create();
+	double start = now();
+
+	for (int i = 0; i < num_elements; i++)
+		url_store_add(store, keys[i], lengths[i], &ids[i]);
+	*rate = num_elements / (now() - start);
+
+	return store;
+}
+
+
+/* decodes every url in order, or in a random order when shuffled */
+static double
+decode(url_store_t * store, uint32_t * ids, int rounds, bool shuffled)
+{
+	uint32_t * order = malloc(num_elements * sizeof(uint32_t)), swap;
+	char url[URL_STORE_MAX];
+	long wrong = 0;
+	double start;
+	int j;
+
+	for (int i = 0; i < num_elements; i++)
+		order[i] = i;
+	for (int i = num_elements - 1; shuffled && i > 0; i--) {
+		j = rand() % (i + 1);
+		swap = order[i];
+		order[i] = order[j];
+		order[j] = swap;
+	}
+
+	start = now();
+	for (int r = 0; r < rounds; r++)
+		for (int i = 0; i < num_elements; i++)
+			wrong += url_store_get(store, ids[order[i]], url) != lengths[order[i]];
+	start = now() - start;
+
+	if (wrong)
+		printf("(%ld wrong!) ", wrong);
+	free(order);
+
+	return (double)num_elements * rounds / start;
+}
+
+
+int
+main(int argc, char * argv[])
+{
+	int rounds = DEFAULT_ROUNDS;
+	size_t bytes = 0, stored, table;
+	uint32_t * ids;
+	url_store_t * store;
+	double rate;
+
+	if (argc > 1)
+		read_keys(argv[1]);
+	else
+		make_keys(DEFAULT_ELEMENTS);
+	if (argc > 2)
+		rounds = atoi(argv[2]);
+	if (num_elements < 1 || rounds < 1) {
+		fprintf(stderr, "Usage: %s [file with one url per line] [rounds]\n", argv[0]);
+		return 1;
+	}
+
+	lengths = malloc(num_elements * sizeof(size_t));
+	for (int i = 0; i < num_elements; i++)
+		bytes += lengths[i] = strlen(keys[i]);
+	ids = malloc(num_elements * sizeof(uint32_t));
+
+	store = fill(ids, &rate);
+	stored = url_store_memory(store);
+	table = arena_bytes();
+
+	printf("%d urls, %zu distinct, %.1f bytes on average\n\n", num_elements, url_store_size(store),
+			(double)bytes / num_elements);
+	printf("%-24s %10s\n", "", "bytes/url");
+	printf("%-24s %10.1f\n", "strings", (double)bytes / num_elements);
+	printf("%-24s %10.1f\n", "url_t in arena + table", (double)table / num_elements);
+	printf("%-24s %10.1f  %.1fx smaller\n", "url store", (double)stored / num_elements, (double)table / stored);
+
+	printf("\n%-24s %10s\n", "", "Murls/s");
+	printf("%-24s %10.2f\n", "add", rate / 1e6);
+	printf("%-24s %10.2f\n", "decode in order", decode(store, ids, rounds, false) / 1e6);
+	printf("%-24s %10.2f\n", "decode shuffled", decode(store, ids, rounds, true) / 1e6);
+
+	url_store_destroy(store);
+	for (int i = 0; i < num_elements; i++)
+		free(keys[i]);
+	free(keys);
+	free(lengths);
+	free(ids);
+
+	return 0;
+}
@@ -1,6 +1,7 @@
 #define _GNU_SOURCE
 
 
+#include <getopt.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <pthread.h>
@@ -10,47 +11,256 @@
 
 #include <curl/curl.h>
 
-#include "lib/hashtable.h"
+#include "lib/ahocorasick.h"
+#include "lib/checkpoint.h"
+#include "lib/frontier.h"
+#include "lib/futex.h"
 #include "lib/linkedlist.h"
-#include "lib/queue.h"
+#include "lib/query.h"
+#include "lib/relevance.h"
+#include "lib/searcher.h"
+#include "lib/url.h"
+#include "lib/urlstore.h"
+#include "lib/visited.h"
+#include "lib/visitedmap.h"
+#include "fetcher.h"
 #include "htmlparser.h"
+#include "htmlscan.h"
 
 
 //#define	NUM_CORES	get_nprocs_conf()
 #define	NUM_CORES	8
-#define QUEUE_CAPACITY	16384
-#define	MAX_DELAY		5000000	// 5 seconds
+#define	POLL_TIMEOUT	50		// ms a worker waits on its sockets before checking the frontier
+#define	URL_MAX			URL_STORE_MAX	// longer links are not followed
+
+// a link's score: how well its anchor text, its url and the page it was
+// found on match the expression
+#define	ANCHOR_WEIGHT	0.5
+#define	URL_WEIGHT		0.25
+#define	PAGE_WEIGHT		0.25
+#define	INHERIT_DECAY	0.5		// of a page's own score that its links inherit when its text does not match at all
+
+
+typedef struct page {
+	url_t * url;
+	uint32_t id;		/* in the url store */
+	float score;		/* the score it was queued with */
+	host_t * host;		/* its connection goes back to the frontier when done */
+	html_parser_t parser;
+	text_matcher_t matcher;		/* single expression mode */
+	pattern_matcher_t patterns;	/* multi-pattern mode */
+	query_matcher_t query;		/* query mode */
+	pattern_matcher_t keywords;	/* words of the expression in the text, for the score of its links */
+	size_t received;		/* bytes of the body seen so far */
+	text_results_t links;
+	span_vector_t * spans;	/* owned by the worker, reused for every chunk */
+} page_t;
+
+
+typedef struct match {
+	url_t * url;	/* NULL if kept in the url store */
+	uint32_t id;
+	int count;		/* patterns found on the page, 0 in single expression mode */
+	int * patterns;
+	size_t * offsets;	/* byte offset of each pattern's first occurrence */
+} match_t;
+
+
+typedef struct worker {
+	span_vector_t spans;
+} worker_t;
+
+
+// gcc -Wall -Wextra -ggdb3 -g -std=gnu99 -pthread -o test crawler.c fetcher.c htmlparser.c htmlscan.c lib/*.c -lm -lcurl
+// valgrind -v --leak-check=full --show-leak-kinds=all --track-origins=yes ./test
+
 
+url_store_t * store;	/* every url seen, the frontier and the results hold their ids */
+visited_t * visited;	/* replaces store when the expected number of urls or a visited file is given */
+visited_map_t * visited_map;	/* the urls earlier crawls fetched, NULL unless a visited file is given */
+linked_list_t * results;
+frontier_t * frontier;
+checkpoint_t * checkpoint;	/* NULL unless the crawl is saved */
+worker_t * workers;
+
+long pending;			/* urls in the frontier or being fetched, the crawl ends at 0 */
+bool crawl_over;		/* no urls are left, or the search is complete */
+event_t work_ready;		/* notified when a host may fetch and when the crawl ends */
+
+int num_workers = NUM_CORES;
+int max_transfers = DEFAULT_MAX_TRANSFERS;	/* concurrent transfers per worker */
+long fetch_timeout = DEFAULT_FETCH_TIMEOUT;	/* seconds a transfer may take */
+size_t frontier_memory = FRONTIER_MEMORY;	/* more queued urls spill to disk */
+int host_connections = FRONTIER_CONNECTIONS;
+double host_rate = FRONTIER_RATE;	/* fetches per second per host */
+int search_flags = 0;
+bool multi_pattern = false;
+bool query_mode = false;
+char * patterns_file = NULL;
+size_t expected_urls = 0;
+double fp_rate = 0;		/* approximate visited set, 0 to keep fingerprints */
+char * visited_file = NULL;
+uint64_t revisit_age = 0;	/* seconds before a url in the visited file is crawled again, 0 for never */
+char * checkpoint_dir = NULL;
+int checkpoint_interval = CHECKPOINT_INTERVAL;	/* seconds between snapshots */
+bool resume = false;
+char * * strip_params = NULL;	/* query parameters that do not change a page */
+int num_strip_params = 0;
+
+searcher_t * searcher;		/* single expression mode */
+ac_automaton_t * automaton;	/* multi-pattern mode */
+query_t * query;		/* query mode */
+relevance_t * relevance;	/* scores links by the words of the expression */
+char * pattern_seen;		/* pattern found on some page already */
+int patterns_left;		/* the crawl stops once every pattern was found */
+
+
+/* where the frontier spills the urls that do not fit in memory */
+static const char *
+spill_dir(void)
+{
+	const char * dir = getenv("TMPDIR");
 
-typedef struct memstruct {
-	char * memory;
-	size_t size;
-} memstruct_t;
+	return dir && *dir ? dir : "/tmp";
+}
 
 
-// gcc -Wall -Wextra -ggdb3 -g -std=gnu99 -pthread -o test crawler.c lib/*.c -lm -lcurl
-// valgrind -v --leak-check=full --show-leak-kinds=all --track-origins=yes ./test
+void
+usage(char * name)
+{
+	fprintf(stderr, "Usage: %s [-i] [-m | -f patterns file | -q] [-t threads] [-c transfers per thread] [-T seconds per transfer] [-H connections per host] [-r requests per second per host] [-M frontier memory in MiB] [-Q query parameters to strip] [-n expected urls [-p false positive rate] | -V visited file [-A seconds before a url is crawled again]] [-C checkpoint dir [-I seconds between snapshots] [--resume]] url [expression...]\n", name);
+	exit(1);
+}
 
 
-hash_table_t * table;
-linked_list_t * results;
-queue_t * work_queue;
+/* adds a comma separated list of query parameter names */
+void
+add_strip_params(char * list)
+{
+	char * name, * save, * * params;
+
+	for (name = strtok_r(list, ",", &save); name; name = strtok_r(NULL, ",", &save)) {
+		if (!(params = realloc(strip_params, (num_strip_params + 1) * sizeof(char *)))) {
+			perror("Error");
+			exit(1);
+		}
+		strip_params = params;
+		strip_params[num_strip_params++] = name;
+	}
+}
 
 
+/* returns the seed url */
 char *
 parse_args(int argc, char * argv[])
 {
-	char * url;
+	static const struct option long_options[] = {
+		{ "resume", no_argument, NULL, 'R' },
+		{ NULL, 0, NULL, 0 }
+	};
+	int opt;
+
+	// '+' stops at the first non-option so the expression may start with '-'
+	while ((opt = getopt_long(argc, argv, "+imf:qt:c:T:H:r:M:Q:n:p:V:A:C:I:", long_options, NULL)) != -1) {
+		switch (opt) {
+		case 't':
+			num_workers = atoi(optarg);
+			break;
+		case 'c':
+			max_transfers = atoi(optarg);
+			break;
+		case 'T':
+			fetch_timeout = atol(optarg);
+			break;
+		case 'H':
+			host_connections = atoi(optarg);
+			break;
+		case 'r':
+			host_rate = atof(optarg);
+			break;
+		case 'M':
+			frontier_memory = strtoul(optarg, NULL, 10) << 20;
+			break;
+		case 'Q':
+			add_strip_params(optarg);
+			break;
+		case 'i':
+			search_flags |= SEARCH_IGNORE_CASE;
+			break;
+		case 'm':
+			multi_pattern = true;
+			break;
+		case 'f':
+			multi_pattern = true;
+			patterns_file = optarg;
+			break;
+		case 'q':
+			query_mode = true;
+			break;
+		case 'n':
+			expected_urls = strtoul(optarg, NULL, 10);
+			break;
+		case 'p':
+			fp_rate = atof(optarg);
+			break;
+		case 'V':
+			visited_file = optarg;
+			break;
+		case 'A':
+			revisit_age = strtoull(optarg, NULL, 10);
+			break;
+		case 'C':
+			checkpoint_dir = optarg;
+			break;
+		case 'I':
+			checkpoint_interval = atoi(optarg);
+			break;
+		case 'R':
+			resume = true;
+			break;
+		default:
+			usage(argv[0]);
+		}
+	}
 
-	if (argc < 3) {
+	if (argc - optind < (patterns_file ? 1 : 2) || num_workers < 1 || max_transfers < 1 || fetch_timeout < 1 ||
+			host_connections < 1 || host_rate <= 0 || frontier_memory == 0 || checkpoint_interval < 1) {
 		fprintf(stderr, "Invalid number of arguments.\n");
-		exit(1);
+		usage(argv[0]);
 	}
 
-	url = malloc((strlen(argv[1]) + 1) * sizeof(char));
-	strcpy(url, argv[1]);
+	if (fp_rate && !expected_urls) {
+		fprintf(stderr, "The false positive rate needs the expected number of urls.\n");
+		usage(argv[0]);
+	}
 
-	return url;
+	if (expected_urls && visited_file) {
+		fprintf(stderr, "The visited set is kept either in memory or in a file.\n");
+		usage(argv[0]);
+	}
+
+	if (revisit_age && !visited_file) {
+		fprintf(stderr, "Crawling urls again needs the visited file.\n");
+		usage(argv[0]);
+	}
+
+	// a checkpoint saves the hashes of the visited urls, not the urls
+	if (checkpoint_dir && !expected_urls && !visited_file) {
+		fprintf(stderr, "Checkpoints need the expected number of urls or the visited file.\n");
+		usage(argv[0]);
+	}
+
+	if (resume && !checkpoint_dir) {
+		fprintf(stderr, "Resuming needs the checkpoint directory.\n");
+		usage(argv[0]);
+	}
+
+	if (strlen(argv[optind]) > URL_MAX) {
+		fprintf(stderr, "The url is too long.\n");
+		usage(argv[0]);
+	}
+
+	return argv[optind];
 }
 
 
@@ -60,13 +270,13 @@ parse_expr(int argc, char * argv[])
 	int i, query_length = 0;
 	char * expression = NULL, * aux;
 
-	for (i = 1; i < argc; i++)
+	for (i = optind + 1; i < argc; i++)
 		query_length += strlen(argv[i]) + 1;	/* stores query length including spaces and \0 */
 
 	expression = calloc(query_length, sizeof(char));
 
-	aux = stpcpy(expression, argv[2]);
-	for (i = 3; i < argc; i++) {
+	aux = stpcpy(expression, argv[optind + 1]);
+	for (i = optind + 2; i < argc; i++) {
 		aux = stpcpy(aux, " ");
 		aux = stpcpy(aux, argv[i]);
 	}
@@ -76,132 +286,635 @@ parse_expr(int argc, char * argv[])
 }
 
 
-unsigned long
-str_hash_function(const void * a)
+/*
+ * Multi-pattern mode: every expression argument is a pattern of its own, and
+ * so is every non-empty line of the patterns file.
+ */
+char * *
+parse_patterns(int argc, char * argv[], int * count)
 {
-	unsigned long hash = 5381;
-	int c;
-	char * str = (char*)a;
+	char * * patterns = malloc(argc * sizeof(char *));
+	char * line = NULL;
+	size_t capacity = 0, length;
+	int i, allocated = argc;
+	FILE * file;
+
+	*count = 0;
+
+	for (i = optind + 1; i < argc; i++)
+		if (*argv[i])
+			patterns[(*count)++] = strdup(argv[i]);
 
-	while ((c = *str++))
-		hash = ((hash << 5) + hash) + c; /* hash * 33 + c */
+	if (!patterns_file)
+		return patterns;
 
-	return hash;
+	if (!(file = fopen(patterns_file, "r"))) {
+		perror(patterns_file);
+		exit(1);
+	}
+
+	while (getline(&line, &capacity, file) != -1) {
+		length = strcspn(line, "\r\n");
+		if (length == 0)
+			continue;
+
+		if (*count == allocated) {
+			allocated *= 2;
+			patterns = realloc(patterns, allocated * sizeof(char *));
+		}
+		patterns[(*count)++] = strndup(line, length);
+	}
+
+	free(line);
+	fclose(file);
+
+	if (*count == 0) {
+		fprintf(stderr, "No patterns given.\n");
+		exit(1);
+	}
+
+	return patterns;
 }
 
 
+/* the body is matched as it arrives instead of being buffered */
 static size_t
 write_mem(void * contents, size_t size, size_t nmemb, void * userp)
 {
 	size_t real_size = size * nmemb;
-	memstruct_t * mem = (memstruct_t *)userp;
+	page_t * page = (page_t *)userp;
+	bool done;
+
+	// without memory the page's links would be lost, it is not worth the rest
+	if (!html_parser_feed(&page->parser, (char*)contents, real_size, page->spans))
+		return 0;
+
+	if (automaton)
+		done = pattern_matcher_feed_spans(&page->patterns, (char*)contents, page->received, page->spans);
+	else if (query)
+		done = query_matcher_feed_spans(&page->query, (char*)contents, page->spans);
+	else
+		done = text_matcher_feed_spans(&page->matcher, (char*)contents, page->spans);
 
-	char * ptr = realloc(mem->memory, mem->size + real_size + 1);
+	if (relevance->keywords)
+		pattern_matcher_feed_spans(&page->keywords, (char*)contents, page->received, page->spans);
 
-	mem->memory = ptr;
-	memcpy(&(mem->memory[mem->size]), contents, real_size);
-	mem->size += real_size;
-	mem->memory[mem->size] = 0;
+	page->received += real_size;
+
+	// returning less than real_size makes curl abort the transfer, there is
+	// no need to download the rest of a page once the expression was found
+	if (done)
+		return 0;
 
 	return real_size;
 }
 
 
-useconds_t
-exponential_backoff(int useconds)
+/* wakes every idle worker so they see crawl_over and leave */
+static void
+end_crawl(void)
+{
+	__atomic_store_n(&crawl_over, true, __ATOMIC_RELEASE);
+	event_notify_all(&work_ready);
+}
+
+
+/*
+ * Counts urls that left the crawl: fetched, already visited or dropped.
+ * Urls are counted in before they can be seen by other workers, so pending
+ * only reaches 0 once the frontier is empty and no page is being fetched.
+ */
+static void
+finish_urls(long count)
+{
+	if (count > 0 && __atomic_sub_fetch(&pending, count, __ATOMIC_ACQ_REL) == 0)
+		end_crawl();
+}
+
+
+/*
+ * Marks the canonical url str as visited. Returns the url, or NULL if it
+ * was visited already, or fetched by an earlier crawl of the visited file
+ * unless force is set. In memory a url is only created once it is new, so
+ * the links seen before, most of them, cost no allocation. With the url
+ * store, id is set to the url's id and the url is only needed until its id
+ * is queued; otherwise the crawl owns the url from then on.
+ */
+static url_t *
+claim_url(const char * str, size_t length, uint32_t * id, bool force)
 {
-	usleep(useconds);
+	url_t * url;
+	uint64_t hash;
+
+	// the store cannot forget a url either, so it is created before it is added
+	if (store) {
+		if (!(url = url_create(str, length)))
+			return NULL;
+		if (!url_store_add(store, str, length, id)) {
+			url_free(url);
+			return NULL;
+		}
+		return url;
+	}
+
+	// the file only learns of a url once it was fetched, see page_done()
+	hash = url_string_hash(str, length);
+	if ((visited_map && !force && visited_map_contains(visited_map, hash, revisit_age)) ||
+			visited_contains(visited, hash))
+		return NULL;
+
+	// a visited set cannot forget a hash, so a url that cannot be created
+	// is not marked and a later link may claim it again
+	if (!(url = url_create(str, length)))
+		return NULL;
+	if (!visited_insert_if_absent(visited, hash)) {
+		url_free(url);
+		return NULL;
+	}
+
+	return url;
+}
+
+
+/*
+ * Resolves link against the URL of the page it was found on and writes its
+ * canonical form to canonical, of URL_MAX + URL_CANONICAL_EXTRA bytes.
+ * Returns its length, or 0 if the link does not point to something we can
+ * crawl.
+ */
+static size_t
+resolve_url(CURLU * base, char * link, char * canonical)
+{
+	CURLU * h = curl_url_dup(base);
+	char * scheme = NULL, * resolved = NULL;
+	size_t length = 0;
+
+	if (curl_url_set(h, CURLUPART_URL, link, 0) != CURLUE_OK)
+		goto out;
+
+	if (curl_url_get(h, CURLUPART_SCHEME, &scheme, 0) != CURLUE_OK ||
+			(strcmp(scheme, "http") && strcmp(scheme, "https")))
+		goto out;
+
+	if (curl_url_get(h, CURLUPART_URL, &resolved, 0) == CURLUE_OK && strlen(resolved) <= URL_MAX)
+		length = url_canonicalize(resolved, strlen(resolved), canonical, strip_params, num_strip_params);
+
+out:
+	curl_free(scheme);
+	curl_free(resolved);
+	curl_url_cleanup(h);
+
+	return length;
+}
 
-	useconds *= 2;
 
-	if (useconds > MAX_DELAY)
+/*
+ * What a page passes on to its links: how much of the expression its text
+ * holds, or if none of it, a part of the score of the page itself, so a
+ * promising path is followed a few pages past the last page that matched.
+ */
+static double
+page_score(page_t * page)
+{
+	if (!relevance->keywords)
 		return 0;
-	
-	return useconds;
+
+	if (page->keywords.found > 0)
+		return (double)page->keywords.found / relevance->keywords->count;
+
+	return page->score * INHERIT_DECAY;
 }
 
 
-void *
-do_work(void * data)
+/*
+ * Resolves the links of a page and queues the new ones, each scored by how
+ * likely it seems to lead to a match. Links are claimed when they are
+ * found, so every url is queued once and each fetch that a host is granted
+ * is a real one.
+ */
+void
+push_links(page_t * page)
+{
+	CURLU * base;
+	text_result_t * iter;
+	url_t * url, * * urls;
+	uint32_t * ids;
+	float * scores;
+	char canonical[URL_MAX + URL_CANONICAL_EXTRA];
+	double inherited = page_score(page) * PAGE_WEIGHT;
+	size_t count = 0, queued, length;
+
+	if (!page->links.head)
+		return;
+
+	base = curl_url();
+	if (curl_url_set(base, CURLUPART_URL, page->url->str, 0) != CURLUE_OK) {
+		curl_url_cleanup(base);
+		return;
+	}
+
+	for (iter = page->links.head; iter != NULL; iter = iter->next)
+		count++;
+
+	urls = malloc(count * sizeof(url_t *));
+	ids = malloc(count * sizeof(uint32_t));
+	scores = malloc(count * sizeof(float));
+	if (!urls || !ids || !scores) {
+		free(urls);
+		free(ids);
+		free(scores);
+		curl_url_cleanup(base);
+		return;
+	}
+
+	count = 0;
+	for (iter = page->links.head; iter != NULL; iter = iter->next) {
+		if (!(length = resolve_url(base, iter->text, canonical)) || !(url = claim_url(canonical, length, &ids[count], false)))
+			continue;
+
+		scores[count] = inherited + URL_WEIGHT * relevance_score(relevance, url->str, url->length);
+		if (iter->anchor)
+			scores[count] += ANCHOR_WEIGHT * relevance_score(relevance, iter->anchor, strlen(iter->anchor));
+		urls[count++] = url;
+	}
+
+	// the page itself is still pending, so the count cannot drop to 0 here
+	__atomic_add_fetch(&pending, count, __ATOMIC_RELAXED);
+	// saved before another worker can fetch them and save that they are done
+	if (checkpoint)
+		checkpoint_queued(checkpoint, urls, scores, count);
+	queued = frontier_push(frontier, urls, store ? ids : NULL, scores, count);
+
+	// a full frontier drops the links, blocking could deadlock the crawl as
+	// every worker is also a producer
+	for (size_t i = queued; i < count; i++)
+		if (checkpoint)
+			checkpoint_done(checkpoint, urls[i]->hash);
+	for (size_t i = store ? 0 : queued; i < count; i++)
+		url_free(urls[i]);
+	finish_urls(count - queued);
+	event_notify(&work_ready, queued);
+
+	free(urls);
+	free(ids);
+	free(scores);
+	curl_url_cleanup(base);
+}
+
+
+/* frees what page_create() allocated, but not the url */
+static void
+page_free(page_t * page)
 {
-	char * url, * expr = (char*)data;
-	useconds_t delay = 1000;
+	if (automaton)
+		pattern_matcher_free(&page->patterns);
+	else if (query)
+		query_matcher_free(&page->query);
+	else
+		text_matcher_free(&page->matcher);
+	if (relevance->keywords)
+		pattern_matcher_free(&page->keywords);
+	free_text_results(page->links.head);
+	free(page);
+}
 
-	CURL * curl_handle;
-	CURLcode res;
-	memstruct_t chunk;
 
-	curl_handle = curl_easy_init();
+/* returns NULL if out of memory, next->url is then still the caller's */
+static page_t *
+page_create(worker_t * worker, frontier_url_t * next, host_t * host)
+{
+	page_t * page = calloc(1, sizeof(page_t));
+	char url[URL_MAX];
+	bool ready;
+
+	if (!page) {
+		perror("Error");
+		return NULL;
+	}
 
-	while (1) {
-		if (!(queue_trypop(work_queue, (void**)&url))) {
-			delay = exponential_backoff(delay);
+	// a url queued by id is decoded for as long as it is fetched
+	page->url = next->url ? next->url : url_create(url, url_store_get(store, next->id, url));
+	if (!page->url) {
+		free(page);
+		return NULL;
+	}
 
-			if (delay == 0)
-				break;
+	page->id = next->id;
+	page->score = next->score;
+	page->host = host;
+	if (automaton)
+		ready = pattern_matcher_init(&page->patterns, automaton);
+	else if (query)
+		ready = query_matcher_init(&page->query, query);
+	else
+		ready = text_matcher_init(&page->matcher, searcher);
+	if (ready && relevance->keywords)
+		ready = pattern_matcher_init(&page->keywords, relevance->keywords);
+	html_parser_init(&page->parser, collect_link, &page->links);
+	page->spans = &worker->spans;
+
+	if (!ready) {
+		if (!next->url)
+			url_free(page->url);
+		page_free(page);
+		return NULL;
+	}
+
+	return page;
+}
+
+
+/*
+ * A match in the checkpoint: the number of patterns, each pattern, each
+ * offset, then the url.
+ */
+static void
+save_match(match_t * match)
+{
+	size_t length = sizeof(uint32_t) + match->count * (sizeof(uint32_t) + sizeof(uint64_t)) + match->url->length;
+	char * data = malloc(length), * p = data;
+	uint32_t value;
+	uint64_t offset;
+
+	if (!data) {
+		perror("Error");
+		return;
+	}
 
+	value = match->count;
+	p = mempcpy(p, &value, sizeof(value));
+	for (int i = 0; i < match->count; i++) {
+		value = match->patterns[i];
+		p = mempcpy(p, &value, sizeof(value));
+	}
+	for (int i = 0; i < match->count; i++) {
+		offset = match->offsets[i];
+		p = mempcpy(p, &offset, sizeof(offset));
+	}
+	memcpy(p, match->url->str, match->url->length);
+
+	checkpoint_match(checkpoint, data, length);
+	free(data);
+}
+
+
+/*
+ * A match of page, which takes the page's url unless the url store has it
+ * already. Returns the url that the page still has to free. Without
+ * memory for the match, match is NULL, the url is printed instead and the
+ * page keeps it.
+ */
+static url_t *
+match_create(page_t * page, match_t * * match)
+{
+	if (!(*match = calloc(1, sizeof(match_t)))) {
+		perror("Error");
+		fprintf(stderr, "A match could not be saved: %s\n", page->url->str);
+		return page->url;
+	}
+
+	if (store) {
+		(*match)->id = page->id;
+		return page->url;
+	}
+
+	(*match)->url = page->url;
+	return NULL;
+}
+
+
+/* records which patterns a page contains, returns true once all were seen */
+static bool
+record_patterns(match_t * match, pattern_matcher_t * matcher)
+{
+	int i, p;
+
+	match->count = matcher->found;
+	match->patterns = malloc(matcher->found * sizeof(int));
+	match->offsets = malloc(matcher->found * sizeof(size_t));
+	if (!match->patterns || !match->offsets) {
+		// the url is still a match, without its patterns
+		perror("Error");
+		free(match->patterns);
+		free(match->offsets);
+		match->patterns = NULL;
+		match->offsets = NULL;
+		match->count = 0;
+	}
+
+	for (i = 0, p = 0; p < automaton->count; p++) {
+		if (matcher->offsets[p] == NOT_FOUND)
 			continue;
-		} else {
-			delay = 1000;
 
-			if (hash_table_contains(table, url))
-				continue;
-			else
-				hash_table_insert(table, url);
+		if (i < match->count) {
+			match->patterns[i] = p;
+			match->offsets[i++] = matcher->offsets[p];
 		}
 
-		chunk.memory = malloc(1);
-		chunk.size = 0;
+		if (!__atomic_exchange_n(&pattern_seen[p], 1, __ATOMIC_RELAXED))
+			__atomic_sub_fetch(&patterns_left, 1, __ATOMIC_RELAXED);
+	}
 
-		// specify URL to get
-		curl_easy_setopt(curl_handle, CURLOPT_URL, url);
-		// send all data do this function
-		curl_easy_setopt(curl_handle, CURLOPT_WRITEFUNCTION, write_mem);
-		// pass the chunk struct to the callback function
-		curl_easy_setopt(curl_handle, CURLOPT_WRITEDATA, (void*)&chunk);
-		// some servers don't like requests that are made without a user-agent
-		// field, so we provide one
-		curl_easy_setopt(curl_handle, CURLOPT_USERAGENT, "libcurl-agent/1.0");
+	linked_list_insert_last(results, (void*)match);
+	if (checkpoint)
+		save_match(match);
 
-		res = curl_easy_perform(curl_handle);
+	return __atomic_load_n(&patterns_left, __ATOMIC_RELAXED) == 0;
+}
 
-		if (res != CURLE_OK)
-			fprintf(stderr, "curl_easy_perform() failed with url %s: %s\n", url, curl_easy_strerror(res));
 
-		text_result_t * result = find_text(chunk.memory);
+/* the transfer was aborted because the page already matched */
+static bool
+page_complete(page_t * page)
+{
+	if (automaton)
+		return page->patterns.found == automaton->count;
+	if (query)
+		return page->query.matched;
 
-		if (find_in_text(expr, result)) {
-			linked_list_insert_last(results, (void*)url);
-			free(chunk.memory);
-			free_text_results(result);
-			break;
+	return page->matcher.found;
+}
+
+
+static void
+page_done(fetcher_t * fetcher, transfer_t * transfer, void * userp)
+{
+	page_t * page = (page_t *)transfer->data;
+	url_t * url = page->url;		/* set to NULL once a match owns it */
+	match_t * match;
+
+	(void)fetcher;
+	(void)userp;
+
+	html_parser_finish(&page->parser);
+
+	// a throttled or slow host slows down before its next url goes out
+	if (frontier_done(frontier, page->host, transfer->status, transfer->time))
+		event_notify(&work_ready, 1);
+
+	// the next crawl of the visited file tries again the pages that
+	// failed or were cut short
+	if (visited_map && (transfer->result == CURLE_OK || page_complete(page)))
+		visited_map_insert_if_absent(visited_map, page->url->hash, revisit_age);
+
+	if (transfer->result == CURLE_ABORTED_BY_CALLBACK)
+		goto out;
+
+	// a write error is how we abort a transfer after a match
+	if (transfer->result != CURLE_OK && !page_complete(page))
+		fprintf(stderr, "transfer failed with url %s: %s\n", transfer->url, curl_easy_strerror(transfer->result));
+
+	if (__atomic_load_n(&crawl_over, __ATOMIC_ACQUIRE))
+		goto out;
+
+	if (automaton) {
+		// pages keep being crawled until every pattern showed up somewhere
+		if (page->patterns.found > 0) {
+			url = match_create(page, &match);
+			if (match && record_patterns(match, &page->patterns))
+				end_crawl();
+		}
+		if (!__atomic_load_n(&crawl_over, __ATOMIC_ACQUIRE))
+			push_links(page);
+	} else if (page_complete(page) ||
+			(query && transfer->result == CURLE_OK && query_matcher_finish(&page->query))) {
+		url = match_create(page, &match);
+		if (match) {
+			linked_list_insert_last(results, (void*)match);
+			if (checkpoint)
+				save_match(match);
+		}
+		end_crawl();
+	} else {
+		push_links(page);
+	}
+
+	// pages cut short when the crawl ended are fetched again on resume
+	if (checkpoint)
+		checkpoint_done(checkpoint, page->url->hash);
+
+out:
+	page_free(page);
+	url_free(url);
+
+	// after its links were counted in
+	finish_urls(1);
+}
+
+
+/*
+ * A url that cannot be fetched is dropped like a failed transfer: the host
+ * gets its connection back and the url leaves the crawl. The checkpoint
+ * still has it pending, so a resumed crawl tries it again.
+ */
+static void
+start_fetch(fetcher_t * fetcher, worker_t * worker, frontier_url_t * next, host_t * host)
+{
+	page_t * page = page_create(worker, next, host);
+
+	if (page && fetcher_add(fetcher, page->url->str, page))
+		return;
+
+	fprintf(stderr, "could not start a transfer, dropping a url\n");
+	if (page) {
+		url_free(page->url);
+		page_free(page);
+	} else {
+		url_free(next->url);
+	}
+
+	if (frontier_done(frontier, host, 0, 0))
+		event_notify(&work_ready, 1);
+	finish_urls(1);
+}
+
+
+/*
+ * Pops up to count urls and starts their fetches. Spilled urls that could
+ * not be read back leave the crawl with the pop that found out; a
+ * checkpoint still has them pending.
+ */
+static size_t
+start_fetches(fetcher_t * fetcher, worker_t * worker, frontier_url_t * next, host_t * * hosts, size_t count,
+		int * wait_ms)
+{
+	size_t popped = frontier_pop(frontier, next, hosts, count, wait_ms);
+
+	finish_urls(frontier_lost(frontier));
+	for (size_t i = 0; i < popped; i++)
+		start_fetch(fetcher, worker, &next[i], hosts[i]);
+
+	return popped;
+}
+
+
+void *
+do_work(void * data)
+{
+	worker_t * worker = (worker_t *)data;
+	fetcher_t * fetcher;
+	frontier_url_t next[max_transfers];
+	host_t * hosts[max_transfers];
+	uint32_t key;
+	int wait;
+
+	span_vector_init(&worker->spans);
+
+	fetcher = fetcher_create(max_transfers, fetch_timeout, write_mem, page_done, worker);
+	if (!fetcher)
+		return NULL;
+
+	while (!__atomic_load_n(&crawl_over, __ATOMIC_ACQUIRE)) {
+		// keep every transfer slot busy while some host may fetch, one
+		// pop fills them all
+		wait = -1;
+		if (fetcher_free_slots(fetcher) > 0)
+			start_fetches(fetcher, worker, next, hosts, fetcher_free_slots(fetcher), &wait);
+
+		if (fetcher_running(fetcher) > 0) {
+			fetcher_poll(fetcher, wait >= 0 && wait < POLL_TIMEOUT ? wait : POLL_TIMEOUT);
+			continue;
 		}
 
-		free(chunk.memory);
-		free_text_results(result);
+		// nothing to fetch: sleep until a host may fetch, another worker
+		// adds urls or the crawl ends, checking once more after announcing
+		// ourselves so none of them can slip in unnoticed
+		key = event_prepare(&work_ready);
+		if (start_fetches(fetcher, worker, next, hosts, fetcher_free_slots(fetcher), &wait) > 0) {
+			event_cancel(&work_ready);
+		} else if (__atomic_load_n(&crawl_over, __ATOMIC_ACQUIRE)) {
+			event_cancel(&work_ready);
+		} else {
+			event_wait(&work_ready, key, wait);
+		}
 	}
 
-	curl_easy_cleanup(curl_handle);
+	fetcher_destroy(fetcher);
+	span_vector_free(&worker->spans);
 
 	return NULL;
 }
 
 
 void
-create_workers(char * expression)
+create_workers(void)
 {
-	pthread_t threads[NUM_CORES];
+	pthread_t threads[num_workers];
 	int i;
 
+	workers = calloc(num_workers, sizeof(worker_t));
+
 	curl_global_init(CURL_GLOBAL_ALL);
 
-	for (i = 0; i < NUM_CORES; i++)
-		pthread_create(&threads[i], NULL, do_work, (void*)expression);
+	for (i = 0; i < num_workers; i++)
+		pthread_create(&threads[i], NULL, do_work, &workers[i]);
 
-	for (i = 0; i < NUM_CORES; i++)
+	for (i = 0; i < num_workers; i++)
 		pthread_join(threads[i], NULL);
 
 	curl_global_cleanup();
+
+	free(workers);
 }
 
 
@@ -212,36 +925,248 @@ void
 print_result(void * value)
 {
 	static int i = 1;
-	char * url = (char*)value;
-
-	printf("\n%d: %s\n", i, url);
+	match_t * match = (match_t*)value;
+	char url[URL_MAX];
+
+	if (match->url)
+		printf("\n%d: %s\n", i, match->url->str);
+	else
+		printf("\n%d: %.*s\n", i, (int)url_store_get(store, match->id, url), url);
+	for (int j = 0; j < match->count; j++)
+		printf("\t\"%s\" at byte %zu\n", automaton->patterns[match->patterns[j]], match->offsets[j]);
 	i++;
 }
 
+
+void
+free_match(void * value)
+{
+	match_t * match = (match_t*)value;
+
+	url_free(match->url);
+	free(match->patterns);
+	free(match->offsets);
+	free(match);
+}
+
+
+static void
+restore_visited(const uint64_t * hashes, size_t count, void * userp)
+{
+	(void)userp;
+
+	if (!visited_add_all(visited, hashes, count))
+		exit(1);
+}
+
+
+static bool
+restore_pending(const char * str, size_t length, float score, void * userp)
+{
+	url_t * url = url_create(str, length);
+
+	(void)userp;
+
+	if (url && frontier_push(frontier, &url, NULL, &score, 1) == 1) {
+		pending++;
+		return true;
+	}
+
+	url_free(url);
+	return false;
+}
+
+
+/* reads back what save_match() wrote, patterns a resumed crawl does not have are left out */
+static void
+restore_match(const void * data, size_t length, void * userp)
+{
+	const char * p = (const char *)data, * end = p + length;
+	match_t * match = calloc(1, sizeof(match_t));
+	uint32_t count, pattern;
+	uint64_t offset;
+	const char * offsets;
+
+	(void)userp;
+
+	if (!match || length < sizeof(count))
+		goto fail;
+
+	memcpy(&count, p, sizeof(count));
+	p += sizeof(count);
+	if (count > (size_t)(end - p) / (sizeof(pattern) + sizeof(offset)))
+		goto fail;
+	offsets = p + count * sizeof(pattern);
+
+	if (automaton && count > 0) {
+		match->patterns = malloc(count * sizeof(int));
+		match->offsets = malloc(count * sizeof(size_t));
+		if (!match->patterns || !match->offsets)
+			goto fail;
+
+		for (uint32_t i = 0; i < count; i++) {
+			memcpy(&pattern, p + i * sizeof(pattern), sizeof(pattern));
+			memcpy(&offset, offsets + i * sizeof(offset), sizeof(offset));
+			if ((int)pattern >= automaton->count)
+				continue;
+
+			match->patterns[match->count] = pattern;
+			match->offsets[match->count++] = offset;
+			if (!pattern_seen[pattern]) {
+				pattern_seen[pattern] = 1;
+				patterns_left--;
+			}
+		}
+	}
+
+	p = offsets + count * sizeof(offset);
+	if (!(match->url = url_create(p, end - p)))
+		goto fail;
+
+	linked_list_insert_last(results, (void*)match);
+	return;
+
+fail:
+	fprintf(stderr, "A saved match could not be restored.\n");
+	if (match) {
+		free(match->patterns);
+		free(match->offsets);
+		free(match);
+	}
+}
+
+
+/* the crawl has nothing left to do once it resumed */
+static bool
+crawl_complete(void)
+{
+	if (pending == 0)
+		return true;
+	if (automaton)
+		return patterns_left == 0;
+
+	return results->len > 0;
+}
+
+
 int
 main(int argc, char * argv[])
 {
-	char * url = parse_args(argc, argv);
-	char * expression = parse_expr(argc, argv);
+	char * seed = parse_args(argc, argv), * expression = NULL, * * patterns = NULL;
+	char canonical[URL_MAX + URL_CANONICAL_EXTRA];
+	url_t * url;
+	uint32_t id;
+	int count = 0;
+
+	// the expression, query or patterns are compiled once and shared
+	// read-only by the workers
+	if (multi_pattern) {
+		patterns = parse_patterns(argc, argv, &count);
+		automaton = ac_create(patterns, count, (search_flags & SEARCH_IGNORE_CASE) ? AC_IGNORE_CASE : 0);
+		if (!automaton)
+			exit(1);
+		if (!(pattern_seen = calloc(count, sizeof(char)))) {
+			perror("Error");
+			exit(1);
+		}
+		patterns_left = count;
+		relevance = relevance_create(patterns, count, 0);
+	} else if (query_mode) {
+		expression = parse_expr(argc, argv);
+		query = query_compile(expression, (search_flags & SEARCH_IGNORE_CASE) ? QUERY_IGNORE_CASE : 0);
+		if (!query)
+			exit(1);
+		relevance = relevance_create(&expression, 1, RELEVANCE_QUERY);
+	} else {
+		expression = parse_expr(argc, argv);
+		searcher = searcher_create(expression, search_flags);
+		if (!searcher)
+			exit(1);
+		relevance = relevance_create(&expression, 1, 0);
+	}
+	if (!relevance)
+		exit(1);
 
 	// initialize data structures
-	table = hash_table_create((hash_table_compare_function)strcmp, str_hash_function, -1);
-	results = linked_list_new(free);
-	queue_create(&work_queue, QUEUE_CAPACITY);
+	// with a visited file, the urls of this crawl are only kept in memory
+	// until they are fetched
+	if (expected_urls)
+		visited = visited_create(expected_urls, fp_rate ? fp_rate : VISITED_FP_RATE, fp_rate ? VISITED_APPROXIMATE : 0);
+	else if (visited_file && (visited_map = visited_map_open(visited_file)))
+		visited = visited_create(VISITED_MAP_SLOTS, VISITED_FP_RATE, 0);
+	else if (!visited_file)
+		store = url_store_create();
+	if (!visited && !store)
+		exit(1);
+	results = linked_list_new(free_match);
+	if (!(frontier = frontier_create(frontier_memory, spill_dir(), host_connections, host_rate)))
+		exit(1);
+
+	if (checkpoint_dir) {
+		checkpoint_handlers_t handlers = { restore_visited, restore_pending, restore_match, NULL };
 
-	queue_push(work_queue, url);
+		if (!(checkpoint = checkpoint_open(checkpoint_dir, resume ? &handlers : NULL)) ||
+				!checkpoint_start(checkpoint, checkpoint_interval))
+			exit(1);
+	}
+
+	// a resumed crawl went past the seed already, a new one always starts
+	// from it, even if the visited file has it
+	if ((url = claim_url(canonical, url_canonicalize(seed, strlen(seed), canonical, strip_params, num_strip_params), &id,
+			!resume))) {
+		pending++;
+		if (checkpoint)
+			checkpoint_queued(checkpoint, &url, NULL, 1);
+		frontier_push(frontier, &url, store ? &id : NULL, NULL, 1);
+		if (store)
+			url_free(url);
+	}
+	crawl_over = crawl_complete();
+
+	// the scanner picks its implementation before the workers share it
+	html_scan_level();
 
 	// do multithreaded work
-	create_workers(expression);
+	create_workers();
+
+	if (checkpoint)
+		checkpoint_close(checkpoint);
 
 	// show the results
 	linked_list_map(results, print_result);
 
 	// free memory allocated by data structures
-	free(expression);
-	hash_table_destroy(table);
-	queue_destroy(work_queue);
+	if (multi_pattern) {
+		for (int i = 0; i < count; i++)
+			free(patterns[i]);
+		free(patterns);
+		free(pattern_seen);
+		ac_destroy(automaton);
+	} else if (query_mode) {
+		query_destroy(query);
+		free(expression);
+	} else {
+		searcher_destroy(searcher);
+		free(expression);
+	}
+	if (visited) {
+		fprintf(stderr, "visited set: %zu urls in %.1f MiB, estimated false positive rate %.3g\n",
+				visited_size(visited), visited_memory(visited) / 1048576.0, visited_fp_rate(visited));
+		visited_destroy(visited);
+	}
+	if (visited_map) {
+		fprintf(stderr, "visited file: %zu urls in %.1f MiB\n",
+				visited_map_size(visited_map), visited_map_memory(visited_map) / 1048576.0);
+		visited_map_close(visited_map);
+	}
+	frontier_destroy(frontier);
+	relevance_destroy(relevance);
 	linked_list_delete(results);
+	free(strip_params);
+	if (store) {
+		fprintf(stderr, "url store: %zu urls in %.1f MiB\n", url_store_size(store), url_store_memory(store) / 1048576.0);
+		url_store_destroy(store);
+	}
 
 	return EXIT_SUCCESS;
 }
\ No newline at end of file
@@ -0,0 +1,307 @@
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <sys/epoll.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "fetcher.h"
+
+
+#define	MAX_EVENTS	64
+
+
+struct fetcher {
+	CURLM * multi;
+	int epfd;
+	long deadline;			/* monotonic ms at which curl's timer fires, -1 if unset */
+	int max_transfers;
+	int running;			/* transfers added and not yet completed */
+	transfer_t * transfers;
+	transfer_t * * free_slots;	/* stack of idle transfers */
+	int num_free;
+	fetcher_write_function write_fn;
+	fetcher_done_function done_fn;
+	void * userp;
+};
+
+
+static long
+now_ms(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+
+	return ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
+}
+
+
+/* curl tells us which events it wants on each socket */
+static int
+handle_socket(CURL * easy, curl_socket_t s, int action, void * userp, void * socketp)
+{
+	fetcher_t * fetcher = (fetcher_t *)userp;
+	struct epoll_event ev = { 0 };
+
+	(void)easy;
+	(void)socketp;
+
+	if (action == CURL_POLL_REMOVE) {
+		epoll_ctl(fetcher->epfd, EPOLL_CTL_DEL, s, NULL);
+		return 0;
+	}
+
+	if (action & CURL_POLL_IN)
+		ev.events |= EPOLLIN;
+	if (action & CURL_POLL_OUT)
+		ev.events |= EPOLLOUT;
+	ev.data.fd = s;
+
+	if (epoll_ctl(fetcher->epfd, EPOLL_CTL_MOD, s, &ev) == -1 && errno == ENOENT)
+		epoll_ctl(fetcher->epfd, EPOLL_CTL_ADD, s, &ev);
+
+	return 0;
+}
+
+
+static int
+handle_timer(CURLM * multi, long timeout_ms, void * userp)
+{
+	fetcher_t * fetcher = (fetcher_t *)userp;
+
+	(void)multi;
+
+	fetcher->deadline = timeout_ms < 0 ? -1 : now_ms() + timeout_ms;
+
+	return 0;
+}
+
+
+fetcher_t *
+fetcher_create(int max_transfers, long timeout, fetcher_write_function write_fn, fetcher_done_function done_fn, void * userp)
+{
+	fetcher_t * fetcher = calloc(1, sizeof(fetcher_t));
+
+	if (!fetcher) {
+		perror("Error");
+		return NULL;
+	}
+	fetcher->epfd = -1;
+
+	if (max_transfers < 1)
+		max_transfers = DEFAULT_MAX_TRANSFERS;
+	if (timeout < 1)
+		timeout = DEFAULT_FETCH_TIMEOUT;
+
+	fetcher->transfers = calloc(max_transfers, sizeof(transfer_t));
+	fetcher->free_slots = malloc(max_transfers * sizeof(transfer_t *));
+	if (!fetcher->transfers || !fetcher->free_slots) {
+		perror("Error");
+		goto error;
+	}
+
+	fetcher->epfd = epoll_create1(EPOLL_CLOEXEC);
+	if (fetcher->epfd == -1) {
+		perror("Error");
+		goto error;
+	}
+
+	if (!(fetcher->multi = curl_multi_init())) {
+		fprintf(stderr, "Error: could not create a curl multi handle\n");
+		goto error;
+	}
+	curl_multi_setopt(fetcher->multi, CURLMOPT_SOCKETFUNCTION, handle_socket);
+	curl_multi_setopt(fetcher->multi, CURLMOPT_SOCKETDATA, fetcher);
+	curl_multi_setopt(fetcher->multi, CURLMOPT_TIMERFUNCTION, handle_timer);
+	curl_multi_setopt(fetcher->multi, CURLMOPT_TIMERDATA, fetcher);
+
+	fetcher->max_transfers = max_transfers;
+	fetcher->deadline = -1;
+	fetcher->write_fn = write_fn;
+	fetcher->done_fn = done_fn;
+	fetcher->userp = userp;
+
+	// easy handles are kept across transfers so their connections get reused
+	for (int i = 0; i < max_transfers; i++) {
+		transfer_t * t = &fetcher->transfers[i];
+
+		if (!(t->handle = curl_easy_init())) {
+			fprintf(stderr, "Error: could not create a curl easy handle\n");
+			goto error;
+		}
+		curl_easy_setopt(t->handle, CURLOPT_PRIVATE, t);
+		curl_easy_setopt(t->handle, CURLOPT_WRITEFUNCTION, write_fn);
+		curl_easy_setopt(t->handle, CURLOPT_NOSIGNAL, 1L);
+		// a server that stops answering must not hold the slot forever
+		curl_easy_setopt(t->handle, CURLOPT_CONNECTTIMEOUT, (long)FETCH_CONNECT_TIMEOUT);
+		curl_easy_setopt(t->handle, CURLOPT_LOW_SPEED_LIMIT, (long)FETCH_LOW_SPEED_LIMIT);
+		curl_easy_setopt(t->handle, CURLOPT_LOW_SPEED_TIME, (long)FETCH_LOW_SPEED_TIME);
+		curl_easy_setopt(t->handle, CURLOPT_TIMEOUT, timeout);
+		// some servers don't like requests that are made without a user-agent
+		// field, so we provide one
+		curl_easy_setopt(t->handle, CURLOPT_USERAGENT, "libcurl-agent/1.0");
+
+		fetcher->free_slots[fetcher->num_free++] = t;
+	}
+
+	return fetcher;
+
+error:
+	for (int i = 0; fetcher->transfers && i < max_transfers; i++)
+		curl_easy_cleanup(fetcher->transfers[i].handle);
+	if (fetcher->multi)
+		curl_multi_cleanup(fetcher->multi);
+	if (fetcher->epfd != -1)
+		close(fetcher->epfd);
+	free(fetcher->transfers);
+	free(fetcher->free_slots);
+	free(fetcher);
+	return NULL;
+}
+
+
+bool
+fetcher_add(fetcher_t * fetcher, char * url, void * data)
+{
+	transfer_t * t;
+
+	if (fetcher->num_free == 0)
+		return false;
+
+	t = fetcher->free_slots[--fetcher->num_free];
+	t->url = url;
+	t->data = data;
+	t->result = CURLE_OK;
+	t->status = 0;
+	t->time = 0;
+
+	curl_easy_setopt(t->handle, CURLOPT_URL, url);
+	curl_easy_setopt(t->handle, CURLOPT_WRITEDATA, data);
+
+	if (curl_multi_add_handle(fetcher->multi, t->handle) != CURLM_OK) {
+		// the caller keeps data, fetcher_destroy() must not finish it again
+		t->url = NULL;
+		t->data = NULL;
+		fetcher->free_slots[fetcher->num_free++] = t;
+		return false;
+	}
+
+	fetcher->running++;
+
+	return true;
+}
+
+
+int
+fetcher_free_slots(fetcher_t * fetcher)
+{
+	return fetcher->num_free;
+}
+
+
+int
+fetcher_running(fetcher_t * fetcher)
+{
+	return fetcher->running;
+}
+
+
+static void
+release_transfer(fetcher_t * fetcher, transfer_t * t)
+{
+	curl_multi_remove_handle(fetcher->multi, t->handle);
+	fetcher->running--;
+
+	fetcher->done_fn(fetcher, t, fetcher->userp);
+
+	t->url = NULL;
+	t->data = NULL;
+	fetcher->free_slots[fetcher->num_free++] = t;
+}
+
+
+static int
+check_done(fetcher_t * fetcher)
+{
+	CURLMsg * msg;
+	transfer_t * t;
+	int pending, done = 0;
+
+	while ((msg = curl_multi_info_read(fetcher->multi, &pending))) {
+		if (msg->msg != CURLMSG_DONE)
+			continue;
+
+		curl_easy_getinfo(msg->easy_handle, CURLINFO_PRIVATE, (char **)&t);
+		t->result = msg->data.result;
+		curl_easy_getinfo(t->handle, CURLINFO_RESPONSE_CODE, &t->status);
+		curl_easy_getinfo(t->handle, CURLINFO_TOTAL_TIME, &t->time);
+
+		release_transfer(fetcher, t);
+		done++;
+	}
+
+	return done;
+}
+
+
+int
+fetcher_poll(fetcher_t * fetcher, int max_wait_ms)
+{
+	struct epoll_event events[MAX_EVENTS];
+	int n, flags, still_running, timeout = max_wait_ms;
+
+	if (fetcher->deadline >= 0) {
+		long left = fetcher->deadline - now_ms();
+
+		if (left < timeout)
+			timeout = left > 0 ? (int)left : 0;
+	}
+
+	n = epoll_wait(fetcher->epfd, events, MAX_EVENTS, timeout);
+	if (n == -1 && errno != EINTR) {
+		perror("Error");
+		return -1;
+	}
+
+	for (int i = 0; i < n; i++) {
+		flags = 0;
+		if (events[i].events & EPOLLIN)
+			flags |= CURL_CSELECT_IN;
+		if (events[i].events & EPOLLOUT)
+			flags |= CURL_CSELECT_OUT;
+		if (events[i].events & (EPOLLERR | EPOLLHUP))
+			flags |= CURL_CSELECT_ERR;
+
+		curl_multi_socket_action(fetcher->multi, events[i].data.fd, flags, &still_running);
+	}
+
+	if (fetcher->deadline >= 0 && now_ms() >= fetcher->deadline) {
+		fetcher->deadline = -1;
+		curl_multi_socket_action(fetcher->multi, CURL_SOCKET_TIMEOUT, 0, &still_running);
+	}
+
+	return check_done(fetcher);
+}
+
+
+void
+fetcher_destroy(fetcher_t * fetcher)
+{
+	for (int i = 0; i < fetcher->max_transfers; i++) {
+		transfer_t * t = &fetcher->transfers[i];
+
+		if (t->url) {
+			t->result = CURLE_ABORTED_BY_CALLBACK;
+			release_transfer(fetcher, t);
+		}
+
+		curl_easy_cleanup(t->handle);
+	}
+
+	curl_multi_cleanup(fetcher->multi);
+	close(fetcher->epfd);
+	free(fetcher->free_slots);
+	free(fetcher->transfers);
+	free(fetcher);
+}
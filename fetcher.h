@@ -0,0 +1,75 @@
+#ifndef FETCHER_H
+#define FETCHER_H
+
+#include <stdbool.h>
+
+#include <curl/curl.h>
+
+
+#define DEFAULT_MAX_TRANSFERS	256
+#define DEFAULT_FETCH_TIMEOUT	60	/* seconds a whole transfer may take */
+#define FETCH_CONNECT_TIMEOUT	10	/* seconds to connect to a server */
+#define FETCH_LOW_SPEED_LIMIT	1	/* bytes per second below which a transfer stalls, */
+#define FETCH_LOW_SPEED_TIME	15	/* for this many seconds before it is aborted */
+
+
+typedef struct transfer {
+	CURL * handle;
+	char * url;
+	void * data;		/* passed to the write function */
+	CURLcode result;
+	long status;		/* HTTP response code, 0 if none was received */
+	double time;		/* seconds from the start of the transfer to its end */
+} transfer_t;
+
+
+typedef struct fetcher fetcher_t;
+
+
+/* receives the body of a transfer as it arrives, same contract as CURLOPT_WRITEFUNCTION */
+typedef size_t (*fetcher_write_function)(void *, size_t, size_t, void *);
+/* called from fetcher_poll() for every transfer that has finished */
+typedef void (*fetcher_done_function)(fetcher_t *, transfer_t *, void *);
+
+
+/*
+ * Creates a fetcher that drives up to max_transfers concurrent transfers on
+ * one curl multi handle, waiting on their sockets with epoll. A fetcher is
+ * not thread-safe: every worker owns its own. A transfer that takes more
+ * than timeout seconds, or stalls, finishes with CURLE_OPERATION_TIMEDOUT.
+ */
+fetcher_t *
+fetcher_create(int max_transfers, long timeout, fetcher_write_function write_fn, fetcher_done_function done_fn, void * userp);
+
+
+/* starts fetching url, returns false if every transfer slot is busy */
+bool
+fetcher_add(fetcher_t * fetcher, char * url, void * data);
+
+
+int
+fetcher_free_slots(fetcher_t * fetcher);
+
+
+int
+fetcher_running(fetcher_t * fetcher);
+
+
+/*
+ * Waits at most max_wait_ms for socket activity, lets curl make progress and
+ * calls the done function for the transfers that completed.
+ * Returns the number of completed transfers, or -1 on error.
+ */
+int
+fetcher_poll(fetcher_t * fetcher, int max_wait_ms);
+
+
+/*
+ * Aborts the transfers still in flight. Their done function is called with
+ * CURLE_ABORTED_BY_CALLBACK so the owner can release the transfer data.
+ */
+void
+fetcher_destroy(fetcher_t * fetcher);
+
+
+#endif /* FETCHER_H */
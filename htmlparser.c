@@ -5,75 +5,702 @@
 
 
 #include "htmlparser.h"
+#include "htmlscan.h"
 
 
-#define	BUFSIZE	1638400
+enum {
+	TEXT_START,		/* skipping the whitespace before a text node */
+	TEXT,
+	TAG_OPEN,		/* right after '<', looking for "!--" */
+	TAG_NAME,
+	ATTR_BEFORE_NAME,
+	ATTR_NAME,
+	ATTR_AFTER_NAME,
+	ATTR_BEFORE_VALUE,
+	ATTR_VALUE,
+	COMMENT
+};
 
 
-int
-clear_whitespace(char * str, int i)
+static bool
+is_space(char c)
 {
-	while (str[i] == ' ' || str[i] == '\n')
-		i++;
+	return c == ' ' || c == '\n' || c == '\t' || c == '\r' || c == '\f';
+}
+
+
+static bool
+is_link_attribute(html_parser_t * parser)
+{
+	return (parser->name_length == 4 && !memcmp(parser->name, "href", 4)) ||
+		(parser->name_length == 3 && !memcmp(parser->name, "src", 3));
+}
+
+
+static bool
+is_tag(html_parser_t * parser, const char * name)
+{
+	return parser->tag_length == (int)strlen(name) && !memcmp(parser->tag, name, parser->tag_length);
+}
+
+
+void
+span_vector_init(span_vector_t * spans)
+{
+	spans->spans = NULL;
+	spans->length = 0;
+	spans->capacity = 0;
+}
+
+
+void
+span_vector_free(span_vector_t * spans)
+{
+	free(spans->spans);
+	span_vector_init(spans);
+}
+
+
+static bool
+push_span(span_vector_t * spans, size_t offset, size_t length, bool end)
+{
+	size_t capacity = spans->capacity ? 2 * spans->capacity : 64;
+	text_span_t * grown;
+
+	if (spans->length == spans->capacity) {
+		if (!(grown = realloc(spans->spans, capacity * sizeof(text_span_t)))) {
+			perror("Error");
+			return false;
+		}
+		spans->spans = grown;
+		spans->capacity = capacity;
+	}
+
+	spans->spans[spans->length].offset = offset;
+	spans->spans[spans->length].length = length;
+	spans->spans[spans->length].end = end;
+	spans->length++;
+
+	return true;
+}
+
+
+/* a value cut short would be a wrong link, so the parser stops if it cannot grow */
+static void
+append_value(html_parser_t * parser, char * str, size_t length)
+{
+	size_t capacity = 2 * (parser->value_length + length);
+	char * grown;
+
+	if (length == 0)
+		return;
+
+	if (parser->value_length + length > parser->value_capacity) {
+		if (!(grown = realloc(parser->value, capacity))) {
+			perror("Error");
+			parser->stopped = true;
+			return;
+		}
+		parser->value = grown;
+		parser->value_capacity = capacity;
+	}
+
+	memcpy(&parser->value[parser->value_length], str, length);
+	parser->value_length += length;
+}
+
+
+/* keeps the text of the open <a>, up to HTML_ANCHOR_MAX bytes, none without memory */
+static void
+append_anchor(html_parser_t * parser, char * str, size_t length)
+{
+	if (length > HTML_ANCHOR_MAX - parser->anchor_length)
+		length = HTML_ANCHOR_MAX - parser->anchor_length;
+	if (length == 0)
+		return;
+
+	if (!parser->anchor && !(parser->anchor = malloc(HTML_ANCHOR_MAX))) {
+		perror("Error");
+		return;
+	}
+
+	memcpy(&parser->anchor[parser->anchor_length], str, length);
+	parser->anchor_length += length;
+}
+
+
+/* reports the href of the open <a> with the text it enclosed */
+static void
+close_anchor(html_parser_t * parser)
+{
+	if (parser->link_length == 0)
+		return;
+
+	if (!parser->on_link(parser->link_data, parser->link, parser->link_length,
+			parser->anchor_length ? parser->anchor : NULL, parser->anchor_length))
+		parser->stopped = true;
+
+	parser->link_length = 0;
+	parser->anchor_length = 0;
+}
+
+
+static void
+end_value(html_parser_t * parser)
+{
+	char * link;
+
+	if (parser->on_link && is_link_attribute(parser) && parser->value_length > 0) {
+		// an <a> is only reported once its text is known
+		if (is_tag(parser, "a") && parser->name_length == 4) {
+			if (parser->value_length > parser->link_capacity) {
+				if (!(link = realloc(parser->link, parser->value_capacity))) {
+					perror("Error");
+					parser->stopped = true;
+					return;
+				}
+				parser->link = link;
+				parser->link_capacity = parser->value_capacity;
+			}
+			memcpy(parser->link, parser->value, parser->value_length);
+			parser->link_length = parser->value_length;
+			parser->anchor_length = 0;
+		} else if (!parser->on_link(parser->link_data, parser->value, parser->value_length, NULL, 0)) {
+			parser->stopped = true;
+		}
+	}
+
+	parser->value_length = 0;
+	parser->state = ATTR_BEFORE_NAME;
+}
+
+
+/* a new <a> or a </a> ends the one that is open */
+static void
+end_tag_name(html_parser_t * parser)
+{
+	if (parser->on_link && (is_tag(parser, "a") || is_tag(parser, "/a")))
+		close_anchor(parser);
+}
+
+
+void
+html_parser_init(html_parser_t * parser, html_link_function on_link, void * link_data)
+{
+	memset(parser, 0, sizeof(html_parser_t));
 
-	return i;
+	parser->state = TEXT_START;
+	parser->on_link = on_link;
+	parser->link_data = link_data;
 }
 
 
-text_result_t *
-find_text(char * html_code)
+/*
+ * Counts the dashes a comment ends with after the run [start, end), so that
+ * "-->" is recognized even when it is split across chunks.
+ */
+static int
+trailing_dashes(char * chunk, size_t start, size_t end, int count)
 {
-	char buffer[BUFSIZE];
-	int i = 0, j;
-	text_result_t * current = NULL, * head = NULL;
+	size_t i = end;
+
+	while (i > start && chunk[i - 1] == '-')
+		i--;
+
+	return i == start ? count + (int)(end - start) : (int)(end - i);
+}
+
+
+/*
+ * Runs of text, names and values are skipped with the block scanner, only
+ * the single characters that change state are handled one at a time.
+ */
+bool
+html_parser_feed(html_parser_t * parser, char * chunk, size_t length, span_vector_t * spans)
+{
+	html_scanner_t scanner;
+	size_t i = 0, start;
+	char c;
+
+	spans->length = 0;
+	html_scanner_init(&scanner, chunk, length);
+
+	while (i < length && !parser->stopped) {
+		switch (parser->state) {
+		case TEXT_START:
+			i = html_scanner_next(&scanner, i, SCAN_NOT_SPACE);
+			if (i == length)
+				break;
+
+			if (chunk[i] == '<') {
+				parser->state = TAG_OPEN;
+				parser->count = 0;
+				i++;
+			} else {
+				parser->state = TEXT;
+				if (parser->anchor_length > 0)
+					append_anchor(parser, " ", 1);
+			}
+			break;
+
+		case TEXT:
+			start = i;
+			i = html_scanner_next(&scanner, i, SCAN_LT);
+
+			if (parser->link_length > 0)
+				append_anchor(parser, &chunk[start], i - start);
+
+			if (!push_span(spans, start, i - start, i < length)) {
+				parser->stopped = true;
+			} else if (i < length) {
+				parser->state = TAG_OPEN;
+				parser->count = 0;
+				i++;
+			}
+			break;
+
+		case TAG_OPEN:
+			if (chunk[i] == "!--"[parser->count]) {
+				i++;
+				if (++parser->count == 3) {
+					parser->state = COMMENT;
+					parser->count = 0;
+				}
+			} else {
+				parser->state = TAG_NAME;
+				parser->tag_length = 0;
+			}
+			break;
+
+		case TAG_NAME:
+			start = i;
+			i = html_scanner_next(&scanner, i, SCAN_GT | SCAN_SPACE);
+
+			for (; start < i && parser->tag_length < 2; start++)
+				parser->tag[parser->tag_length++] = chunk[start] | 0x20;	/* ASCII lowercase */
+			parser->tag_length += i - start;
+
+			if (i == length)
+				break;
+
+			end_tag_name(parser);
+			parser->state = chunk[i] == '>' ? TEXT_START : ATTR_BEFORE_NAME;
+			i++;
+			break;
+
+		case ATTR_BEFORE_NAME:
+			c = chunk[i];
+			if (c == '>') {
+				parser->state = TEXT_START;
+				i++;
+			} else if (is_space(c) || c == '/') {
+				i++;
+			} else {
+				parser->state = ATTR_NAME;
+				parser->name_length = 0;
+			}
+			break;
 
-	i = clear_whitespace(html_code, i);
+		case ATTR_NAME:
+			start = i;
+			i = html_scanner_next(&scanner, i, SCAN_GT | SCAN_EQ | SCAN_SPACE);
 
-	while (html_code[i++] != '\0') {
+			for (; start < i && parser->name_length < 4; start++)
+				parser->name[parser->name_length++] = chunk[start] | 0x20;	/* ASCII lowercase */
+			parser->name_length += i - start;
 
-		while (html_code[i++] != '>');
+			if (i == length)
+				break;
 
-		i = clear_whitespace(html_code, i);
+			c = chunk[i];
+			if (c == '>')
+				parser->state = TEXT_START;
+			else if (c == '=')
+				parser->state = ATTR_BEFORE_VALUE;
+			else
+				parser->state = ATTR_AFTER_NAME;
+			i++;
+			break;
+
+		case ATTR_AFTER_NAME:
+			c = chunk[i];
+			if (c == '=') {
+				parser->state = ATTR_BEFORE_VALUE;
+				i++;
+			} else if (is_space(c)) {
+				i++;
+			} else {
+				parser->state = ATTR_BEFORE_NAME;	/* attribute without value */
+			}
+			break;
+
+		case ATTR_BEFORE_VALUE:
+			c = chunk[i];
+			if (is_space(c)) {
+				i++;
+				break;
+			}
 
-		if (html_code[i] == '<')
-			continue;
+			parser->quote = (c == '"' || c == '\'') ? c : 0;
+			parser->value_length = 0;
+			parser->state = ATTR_VALUE;
+			if (parser->quote)
+				i++;
+			break;
+
+		case ATTR_VALUE:
+			start = i;
+			if (parser->quote == '"')
+				i = html_scanner_next(&scanner, i, SCAN_DQUOTE);
+			else if (parser->quote == '\'')
+				i = html_scanner_next(&scanner, i, SCAN_SQUOTE);
+			else
+				i = html_scanner_next(&scanner, i, SCAN_GT | SCAN_SPACE);
 
-		i = clear_whitespace(html_code, i);
+			if (is_link_attribute(parser))
+				append_value(parser, &chunk[start], i - start);
 
-		if (html_code[i] == '\0')
+			if (i < length) {
+				end_value(parser);
+				if (parser->quote)
+					i++;	/* closing quote, a '>' or space is handled by the next state */
+			}
 			break;
 
-		j = 0;
-		while (html_code[i] != '<')
-			buffer[j++] = html_code[i++];
-		buffer[j] = '\0';
-
-		text_result_t * result = malloc(sizeof(text_result_t));
-		result->next = NULL;
-		result->text = malloc((strlen(buffer) + 1) * sizeof(char));
-		strcpy(result->text, buffer);
-
-		if (current) {
-			current->next = result;
-			current = result;
-		} else {
-			head = result;
-			current = result;
+		case COMMENT:
+			start = i;
+			i = html_scanner_next(&scanner, i, SCAN_GT);
+			parser->count = trailing_dashes(chunk, start, i, parser->count);
+
+			if (i == length)
+				break;
+
+			if (parser->count >= 2)
+				parser->state = TEXT_START;
+			parser->count = 0;
+			i++;
+			break;
 		}
 	}
 
-	return head;
+	return !parser->stopped;
+}
+
+
+void
+html_parser_finish(html_parser_t * parser)
+{
+	if (!parser->stopped && parser->state == ATTR_VALUE)
+		end_value(parser);
+	if (!parser->stopped && parser->on_link)
+		close_anchor(parser);
+
+	free(parser->value);
+	free(parser->link);
+	free(parser->anchor);
+	parser->value = NULL;
+	parser->link = NULL;
+	parser->anchor = NULL;
+	parser->value_capacity = 0;
+	parser->link_capacity = 0;
+	parser->link_length = 0;
+	parser->anchor_length = 0;
+	parser->state = TEXT_START;
+}
+
+
+static bool
+append_result(text_results_t * results, char * str, size_t length, char * anchor, size_t anchor_length)
+{
+	text_result_t * result = malloc(sizeof(text_result_t));
+
+	if (!result) {
+		perror("Error");
+		return false;
+	}
+
+	result->next = NULL;
+	result->anchor = NULL;
+	if (!(result->text = malloc((length + 1) * sizeof(char))) ||
+			(anchor && !(result->anchor = malloc(anchor_length + 1)))) {
+		perror("Error");
+		free(result->text);
+		free(result);
+		return false;
+	}
+
+	memcpy(result->text, str, length);
+	result->text[length] = '\0';
+	if (anchor) {
+		memcpy(result->anchor, anchor, anchor_length);
+		result->anchor[anchor_length] = '\0';
+	}
+
+	if (results->tail)
+		results->tail->next = result;
+	else
+		results->head = result;
+	results->tail = result;
+
+	return true;
 }
 
 
 bool
-find_in_text(char * expr, text_result_t * result)
+collect_link(void * data, char * link, size_t length, char * anchor, size_t anchor_length)
 {
-	text_result_t * iter;
+	return append_result((text_results_t *)data, link, length, anchor, anchor_length);
+}
+
 
-	for (iter = result; iter != NULL; iter = iter->next)
-		if (strstr(iter->text, expr))
+bool
+text_matcher_init(text_matcher_t * matcher, const searcher_t * searcher)
+{
+	matcher->searcher = searcher;
+	matcher->length = searcher->length;
+	matcher->carry_length = 0;
+	matcher->found = false;
+
+	if (!(matcher->window = malloc(2 * matcher->length + 1))) {
+		perror("Error");
+		return false;
+	}
+
+	return true;
+}
+
+
+bool
+text_matcher_feed(text_matcher_t * matcher, char * text, size_t length, bool end)
+{
+	size_t keep = matcher->length - 1, head, total;
+
+	if (matcher->length == 0) {
+		matcher->found = true;
+		return true;
+	}
+
+	// an occurrence may straddle the previous fragment and this one
+	if (matcher->carry_length > 0 && length > 0) {
+		head = length < keep ? length : keep;
+		memcpy(&matcher->window[matcher->carry_length], text, head);
+		if (searcher_find(matcher->searcher, matcher->window, matcher->carry_length + head) >= 0)
+			matcher->found = true;
+	}
+
+	if (!matcher->found && searcher_find(matcher->searcher, text, length) >= 0)
+		matcher->found = true;
+
+	if (matcher->found)
+		return true;
+
+	if (end) {
+		matcher->carry_length = 0;
+		return false;
+	}
+
+	// keep the last length - 1 bytes of the node seen so far
+	if (length >= keep) {
+		memcpy(matcher->window, &text[length - keep], keep);
+		matcher->carry_length = keep;
+	} else {
+		if (matcher->carry_length == 0)
+			memcpy(matcher->window, text, length);
+
+		total = matcher->carry_length + length;
+		if (total > keep) {
+			memmove(matcher->window, &matcher->window[total - keep], keep);
+			total = keep;
+		}
+		matcher->carry_length = total;
+	}
+
+	return false;
+}
+
+
+bool
+text_matcher_feed_spans(text_matcher_t * matcher, char * chunk, span_vector_t * spans)
+{
+	text_span_t * span;
+
+	for (size_t i = 0; i < spans->length; i++) {
+		span = &spans->spans[i];
+		if (text_matcher_feed(matcher, &chunk[span->offset], span->length, span->end))
 			return true;
+	}
+
+	return false;
+}
+
+
+void
+text_matcher_free(text_matcher_t * matcher)
+{
+	free(matcher->window);
+	matcher->window = NULL;
+}
+
+
+bool
+pattern_matcher_init(pattern_matcher_t * matcher, const ac_automaton_t * automaton)
+{
+	matcher->automaton = automaton;
+	matcher->state = AC_START;
+	matcher->found = 0;
+	matcher->chunk_offset = 0;
+
+	if (!(matcher->offsets = malloc(automaton->count * sizeof(size_t)))) {
+		perror("Error");
+		return false;
+	}
+
+	for (int i = 0; i < automaton->count; i++)
+		matcher->offsets[i] = NOT_FOUND;
+
+	return true;
+}
+
+
+static bool
+record_pattern(int pattern, size_t end, void * data)
+{
+	pattern_matcher_t * matcher = (pattern_matcher_t *)data;
+
+	if (matcher->offsets[pattern] == NOT_FOUND) {
+		matcher->offsets[pattern] = matcher->chunk_offset + end - matcher->automaton->lengths[pattern];
+		matcher->found++;
+	}
+
+	return matcher->found < matcher->automaton->count;
+}
+
+
+bool
+pattern_matcher_feed_spans(pattern_matcher_t * matcher, char * chunk, size_t chunk_offset, span_vector_t * spans)
+{
+	text_span_t * span;
+
+	for (size_t i = 0; i < spans->length && matcher->found < matcher->automaton->count; i++) {
+		span = &spans->spans[i];
+
+		matcher->chunk_offset = chunk_offset + span->offset;
+		matcher->state = ac_scan(matcher->automaton, matcher->state, &chunk[span->offset], span->length, record_pattern, matcher);
+
+		// patterns do not match across text nodes
+		if (span->end)
+			matcher->state = AC_START;
+	}
+
+	return matcher->found == matcher->automaton->count;
+}
+
+
+void
+pattern_matcher_free(pattern_matcher_t * matcher)
+{
+	free(matcher->offsets);
+	matcher->offsets = NULL;
+}
+
+
+bool
+query_matcher_init(query_matcher_t * matcher, const query_t * query)
+{
+	matcher->query = query;
+	matcher->found = 0;
+	matcher->matched = false;
+
+	if (!(matcher->states = malloc(query->num_dfas * sizeof(uint32_t)))) {
+		perror("Error");
+		return false;
+	}
+
+	for (int i = 0; i < query->num_dfas; i++)
+		matcher->states[i] = DFA_START;
+
+	return true;
+}
+
+
+bool
+query_matcher_feed_spans(query_matcher_t * matcher, char * chunk, span_vector_t * spans)
+{
+	const query_t * query = matcher->query;
+	text_span_t * span;
+	dfa_t * dfa;
+
+	if (matcher->matched)
+		return true;
+
+	for (size_t i = 0; i < spans->length; i++) {
+		span = &spans->spans[i];
+
+		for (int d = 0; d < query->num_dfas; d++) {
+			dfa = query->dfas[d];
+
+			// nothing left to learn from an automaton whose terms were all seen
+			if ((matcher->found & dfa->atoms) == dfa->atoms)
+				continue;
+
+			matcher->states[d] = dfa_scan(dfa, matcher->states[d], &chunk[span->offset], span->length, &matcher->found);
+
+			// terms do not match across text nodes
+			if (span->end)
+				matcher->states[d] = DFA_START;
+		}
+	}
+
+	matcher->matched = query_eval(query, matcher->found, false) == QUERY_TRUE;
+
+	return matcher->matched;
+}
+
+
+bool
+query_matcher_finish(query_matcher_t * matcher)
+{
+	if (!matcher->matched)
+		matcher->matched = query_eval(matcher->query, matcher->found, true) == QUERY_TRUE;
+
+	return matcher->matched;
+}
+
+
+void
+query_matcher_free(query_matcher_t * matcher)
+{
+	free(matcher->states);
+	matcher->states = NULL;
+}
+
+
+void
+find_text(char * html_code, size_t length, span_vector_t * spans, text_result_t ** links)
+{
+	html_parser_t parser;
+	text_results_t link_list = { NULL, NULL };
+
+	html_parser_init(&parser, links ? collect_link : NULL, &link_list);
+	html_parser_feed(&parser, html_code, length, spans);
+	html_parser_finish(&parser);
+
+	if (links)
+		*links = link_list.head;
+}
+
+
+/* a whole document is fed at once, so every span is a complete text node */
+bool
+find_in_text(const searcher_t * searcher, char * html_code, span_vector_t * spans)
+{
+	text_span_t * span;
+
+	for (size_t i = 0; i < spans->length; i++) {
+		span = &spans->spans[i];
+		if (searcher_find(searcher, &html_code[span->offset], span->length) >= 0)
+			return true;
+	}
 
 	return false;
 }
@@ -88,7 +715,7 @@ free_text_results(text_result_t * head)
 		aux = head;
 		head = head->next;
 		free(aux->text);
+		free(aux->anchor);
 		free(aux);
 	}
 }
-
@@ -1,18 +1,202 @@
 
+
 #include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "lib/ahocorasick.h"
+#include "lib/query.h"
+#include "lib/searcher.h"
 
 typedef struct text_result {
 	char * text;
+	char * anchor;		/* text of the <a> element of a link, NULL if it has none */
 	struct text_result * next;
 } text_result_t;
 
 
-text_result_t *
-find_text(char * html_code);
+typedef struct text_results {
+	text_result_t * head;
+	text_result_t * tail;
+} text_results_t;
+
+
+/* a text node, or the part of it that lies in one chunk, by position */
+typedef struct text_span {
+	size_t offset;
+	size_t length;
+	bool end;		/* last fragment of its text node */
+} text_span_t;
+
+
+/* reusable array of spans, each worker keeps one for all its pages */
+typedef struct span_vector {
+	text_span_t * spans;
+	size_t length;
+	size_t capacity;
+} span_vector_t;
+
+
+#define	HTML_ANCHOR_MAX	256		/* bytes of anchor text kept per link */
+
+
+/*
+ * Receives the unresolved value of an href or src attribute, and for the
+ * href of an <a> element the text inside it, or NULL.
+ */
+typedef bool (*html_link_function)(void *, char *, size_t, char *, size_t);
+
+
+/* incremental tokenizer, the body can be fed to it in arbitrary chunks */
+typedef struct html_parser {
+	int state;
+	int count;		/* chars of "<!--" seen, or trailing dashes in a comment */
+	char name[4];		/* lowercased start of the current attribute name */
+	int name_length;
+	char tag[2];		/* lowercased start of the current tag name */
+	int tag_length;
+	char quote;
+	char * value;		/* link being accumulated */
+	size_t value_length;
+	size_t value_capacity;
+	char * link;		/* href of the open <a>, reported with its text when it closes */
+	size_t link_length;
+	size_t link_capacity;
+	char * anchor;		/* text of the open <a> so far */
+	size_t anchor_length;
+	bool stopped;
+	html_link_function on_link;
+	void * link_data;
+} html_parser_t;
+
+
+/* matches an expression against text nodes fed to it in fragments */
+typedef struct text_matcher {
+	const searcher_t * searcher;	/* shared by every page */
+	size_t length;
+	char * window;		/* tail of the current text node, then the next fragment's head */
+	size_t carry_length;
+	bool found;
+} text_matcher_t;
+
+
+/* reports where every pattern of an automaton first occurs in a body */
+typedef struct pattern_matcher {
+	const ac_automaton_t * automaton;	/* shared by every page */
+	uint32_t state;
+	size_t * offsets;	/* body offset of each pattern's first occurrence */
+	int found;		/* number of distinct patterns seen */
+	size_t chunk_offset;	/* body offset of the chunk being scanned */
+} pattern_matcher_t;
+
+
+#define	NOT_FOUND	((size_t)-1)
+
+
+/* evaluates a query against the text nodes of a body */
+typedef struct query_matcher {
+	const query_t * query;	/* shared by every page */
+	uint32_t * states;	/* one per automaton of the query */
+	uint64_t found;		/* terms seen so far */
+	bool matched;		/* true whatever the rest of the body holds */
+} query_matcher_t;
+
+
+void
+span_vector_init(span_vector_t * spans);
+
+
+void
+span_vector_free(span_vector_t * spans);
+
+
+void
+html_parser_init(html_parser_t * parser, html_link_function on_link, void * link_data);
+
+
+/*
+ * Tokenizes the next chunk of a body. spans is cleared and filled with the
+ * text of this chunk, as offsets into it. Returns false once the link
+ * function has stopped the parser, or it ran out of memory.
+ */
+bool
+html_parser_feed(html_parser_t * parser, char * chunk, size_t length, span_vector_t * spans);
+
+
+/* flushes a pending link and releases the parser's buffers */
+void
+html_parser_finish(html_parser_t * parser);
+
+
+/* appends the link to a text_results_t, stops the parser without memory */
+bool
+collect_link(void * results, char * link, size_t length, char * anchor, size_t anchor_length);
+
+
+bool
+text_matcher_init(text_matcher_t * matcher, const searcher_t * searcher);
+
+
+/* feeds one fragment of a text node, returns true once the expression was found */
+bool
+text_matcher_feed(text_matcher_t * matcher, char * text, size_t length, bool end);
+
+
+/* feeds every span of a chunk, returns true once the expression was found */
+bool
+text_matcher_feed_spans(text_matcher_t * matcher, char * chunk, span_vector_t * spans);
+
+
+void
+text_matcher_free(text_matcher_t * matcher);
+
+
+bool
+pattern_matcher_init(pattern_matcher_t * matcher, const ac_automaton_t * automaton);
+
+
+/*
+ * Feeds every span of a chunk that starts at chunk_offset in the body.
+ * Returns true once every pattern was found.
+ */
+bool
+pattern_matcher_feed_spans(pattern_matcher_t * matcher, char * chunk, size_t chunk_offset, span_vector_t * spans);
+
+
+void
+pattern_matcher_free(pattern_matcher_t * matcher);
+
+
+bool
+query_matcher_init(query_matcher_t * matcher, const query_t * query);
+
+
+/* returns true once the query holds whatever the rest of the body holds */
+bool
+query_matcher_feed_spans(query_matcher_t * matcher, char * chunk, span_vector_t * spans);
+
+
+/* the value of the query once the whole body was fed */
+bool
+query_matcher_finish(query_matcher_t * matcher);
+
+
+void
+query_matcher_free(query_matcher_t * matcher);
+
+
+/*
+ * Finds the text between tags of a whole document, without copying it: spans
+ * is filled with the position of every text node in html_code. When links is
+ * not NULL the href and src targets found during the same scan are returned
+ * through it, unresolved.
+ */
+void
+find_text(char * html_code, size_t length, span_vector_t * spans, text_result_t ** links);
 
 
 bool
-find_in_text(char * expr, text_result_t * result);
+find_in_text(const searcher_t * searcher, char * html_code, span_vector_t * spans);
 
 
 void
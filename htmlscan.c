@@ -0,0 +1,264 @@
+#include <string.h>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define	SCAN_X86
+#endif
+
+#include "htmlscan.h"
+
+
+typedef void (*classify_function)(const char *, scan_masks_t *);
+
+static void classify_resolve(const char * block, scan_masks_t * masks);
+
+// read by every worker for every block, so they are only accessed atomically
+static classify_function classify = classify_resolve;
+static scan_level_t current_level = SCAN_SCALAR;
+
+
+static inline void
+classify_block(const char * block, scan_masks_t * masks)
+{
+	__atomic_load_n(&classify, __ATOMIC_ACQUIRE)(block, masks);
+}
+
+
+static void
+classify_scalar(const char * block, scan_masks_t * masks)
+{
+	uint64_t bit;
+
+	memset(masks, 0, sizeof(scan_masks_t));
+
+	for (int i = 0; i < SCAN_BLOCK; i++) {
+		bit = (uint64_t)1 << i;
+
+		switch (block[i]) {
+		case '<':
+			masks->lt |= bit;
+			break;
+		case '>':
+			masks->gt |= bit;
+			break;
+		case '=':
+			masks->eq |= bit;
+			break;
+		case ' ': case '\n': case '\t': case '\r': case '\f':
+			masks->space |= bit;
+			break;
+		case '"':
+			masks->dquote |= bit;
+			break;
+		case '\'':
+			masks->squote |= bit;
+			break;
+		case '-':
+			masks->dash |= bit;
+			break;
+		}
+	}
+}
+
+
+#ifdef SCAN_X86
+
+static void
+classify_sse2(const char * block, scan_masks_t * masks)
+{
+	memset(masks, 0, sizeof(scan_masks_t));
+
+	for (int i = 0; i < SCAN_BLOCK; i += 16) {
+		__m128i v = _mm_loadu_si128((const __m128i *)&block[i]);
+		__m128i space = _mm_or_si128(
+			_mm_or_si128(_mm_cmpeq_epi8(v, _mm_set1_epi8(' ')), _mm_cmpeq_epi8(v, _mm_set1_epi8('\n'))),
+			_mm_or_si128(_mm_or_si128(_mm_cmpeq_epi8(v, _mm_set1_epi8('\t')), _mm_cmpeq_epi8(v, _mm_set1_epi8('\r'))),
+				_mm_cmpeq_epi8(v, _mm_set1_epi8('\f'))));
+
+#define	MASK(cmp)	((uint64_t)(uint16_t)_mm_movemask_epi8(cmp) << i)
+		masks->lt |= MASK(_mm_cmpeq_epi8(v, _mm_set1_epi8('<')));
+		masks->gt |= MASK(_mm_cmpeq_epi8(v, _mm_set1_epi8('>')));
+		masks->eq |= MASK(_mm_cmpeq_epi8(v, _mm_set1_epi8('=')));
+		masks->space |= MASK(space);
+		masks->dquote |= MASK(_mm_cmpeq_epi8(v, _mm_set1_epi8('"')));
+		masks->squote |= MASK(_mm_cmpeq_epi8(v, _mm_set1_epi8('\'')));
+		masks->dash |= MASK(_mm_cmpeq_epi8(v, _mm_set1_epi8('-')));
+#undef MASK
+	}
+}
+
+
+__attribute__((target("avx2")))
+static void
+classify_avx2(const char * block, scan_masks_t * masks)
+{
+	memset(masks, 0, sizeof(scan_masks_t));
+
+	for (int i = 0; i < SCAN_BLOCK; i += 32) {
+		__m256i v = _mm256_loadu_si256((const __m256i *)&block[i]);
+		__m256i space = _mm256_or_si256(
+			_mm256_or_si256(_mm256_cmpeq_epi8(v, _mm256_set1_epi8(' ')), _mm256_cmpeq_epi8(v, _mm256_set1_epi8('\n'))),
+			_mm256_or_si256(_mm256_or_si256(_mm256_cmpeq_epi8(v, _mm256_set1_epi8('\t')), _mm256_cmpeq_epi8(v, _mm256_set1_epi8('\r'))),
+				_mm256_cmpeq_epi8(v, _mm256_set1_epi8('\f'))));
+
+#define	MASK(cmp)	((uint64_t)(uint32_t)_mm256_movemask_epi8(cmp) << i)
+		masks->lt |= MASK(_mm256_cmpeq_epi8(v, _mm256_set1_epi8('<')));
+		masks->gt |= MASK(_mm256_cmpeq_epi8(v, _mm256_set1_epi8('>')));
+		masks->eq |= MASK(_mm256_cmpeq_epi8(v, _mm256_set1_epi8('=')));
+		masks->space |= MASK(space);
+		masks->dquote |= MASK(_mm256_cmpeq_epi8(v, _mm256_set1_epi8('"')));
+		masks->squote |= MASK(_mm256_cmpeq_epi8(v, _mm256_set1_epi8('\'')));
+		masks->dash |= MASK(_mm256_cmpeq_epi8(v, _mm256_set1_epi8('-')));
+#undef MASK
+	}
+}
+
+
+__attribute__((target("avx512f,avx512bw")))
+static void
+classify_avx512(const char * block, scan_masks_t * masks)
+{
+	__m512i v = _mm512_loadu_si512((const void *)block);
+
+	masks->lt = _mm512_cmpeq_epi8_mask(v, _mm512_set1_epi8('<'));
+	masks->gt = _mm512_cmpeq_epi8_mask(v, _mm512_set1_epi8('>'));
+	masks->eq = _mm512_cmpeq_epi8_mask(v, _mm512_set1_epi8('='));
+	masks->space = _mm512_cmpeq_epi8_mask(v, _mm512_set1_epi8(' ')) |
+		_mm512_cmpeq_epi8_mask(v, _mm512_set1_epi8('\n')) |
+		_mm512_cmpeq_epi8_mask(v, _mm512_set1_epi8('\t')) |
+		_mm512_cmpeq_epi8_mask(v, _mm512_set1_epi8('\r')) |
+		_mm512_cmpeq_epi8_mask(v, _mm512_set1_epi8('\f'));
+	masks->dquote = _mm512_cmpeq_epi8_mask(v, _mm512_set1_epi8('"'));
+	masks->squote = _mm512_cmpeq_epi8_mask(v, _mm512_set1_epi8('\''));
+	masks->dash = _mm512_cmpeq_epi8_mask(v, _mm512_set1_epi8('-'));
+}
+
+#endif /* SCAN_X86 */
+
+
+static bool
+level_supported(scan_level_t level)
+{
+	switch (level) {
+	case SCAN_SCALAR:
+		return true;
+#ifdef SCAN_X86
+	case SCAN_SSE2:
+		return __builtin_cpu_supports("sse2");
+	case SCAN_AVX2:
+		return __builtin_cpu_supports("avx2");
+	case SCAN_AVX512:
+		return __builtin_cpu_supports("avx512f") && __builtin_cpu_supports("avx512bw");
+#endif
+	default:
+		return false;
+	}
+}
+
+
+bool
+html_scan_set_level(scan_level_t level)
+{
+	classify_function function;
+
+	if (!level_supported(level))
+		return false;
+
+	switch (level) {
+#ifdef SCAN_X86
+	case SCAN_SSE2:
+		function = classify_sse2;
+		break;
+	case SCAN_AVX2:
+		function = classify_avx2;
+		break;
+	case SCAN_AVX512:
+		function = classify_avx512;
+		break;
+#endif
+	default:
+		function = classify_scalar;
+		break;
+	}
+
+	__atomic_store_n(&current_level, level, __ATOMIC_RELAXED);
+	__atomic_store_n(&classify, function, __ATOMIC_RELEASE);
+
+	return true;
+}
+
+
+/*
+ * Picks the widest implementation on first use. html_scan_level() resolves
+ * it before the workers start; if they race here anyway, they all store the
+ * same pointer atomically.
+ */
+static void
+classify_resolve(const char * block, scan_masks_t * masks)
+{
+	int level;
+
+#ifdef SCAN_X86
+	__builtin_cpu_init();
+#endif
+
+	for (level = SCAN_AVX512; level > SCAN_SCALAR; level--)
+		if (html_scan_set_level(level))
+			break;
+
+	if (level == SCAN_SCALAR)
+		html_scan_set_level(SCAN_SCALAR);
+
+	classify_block(block, masks);
+}
+
+
+void
+html_classify(const char * block, scan_masks_t * masks)
+{
+	classify_block(block, masks);
+}
+
+
+scan_level_t
+html_scan_level(void)
+{
+	if (__atomic_load_n(&classify, __ATOMIC_ACQUIRE) == classify_resolve) {
+		scan_masks_t masks;
+		char block[SCAN_BLOCK] = { 0 };
+
+		classify_resolve(block, &masks);
+	}
+
+	return __atomic_load_n(&current_level, __ATOMIC_RELAXED);
+}
+
+
+void
+html_scanner_init(html_scanner_t * scanner, const char * data, size_t length)
+{
+	scanner->data = data;
+	scanner->length = length;
+	scanner->block = 0;
+	scanner->valid = false;
+}
+
+
+void
+html_scanner_load(html_scanner_t * scanner, size_t block)
+{
+	char padded[SCAN_BLOCK];
+
+	// the last block is copied so we never read past the buffer, the zero
+	// padding belongs to no class
+	if (block + SCAN_BLOCK <= scanner->length) {
+		classify_block(&scanner->data[block], &scanner->masks);
+	} else {
+		memset(padded, 0, SCAN_BLOCK);
+		memcpy(padded, &scanner->data[block], scanner->length - block);
+		classify_block(padded, &scanner->masks);
+	}
+
+	scanner->block = block;
+	scanner->valid = true;
+}
@@ -0,0 +1,133 @@
+#ifndef HTMLSCAN_H
+#define HTMLSCAN_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+
+#define	SCAN_BLOCK	64
+
+
+/* character classes, can be combined when looking for the next boundary */
+#define	SCAN_LT			(1 << 0)	/* '<' */
+#define	SCAN_GT			(1 << 1)	/* '>' */
+#define	SCAN_EQ			(1 << 2)	/* '=' */
+#define	SCAN_SPACE		(1 << 3)	/* ' ', '\n', '\t', '\r', '\f' */
+#define	SCAN_DQUOTE		(1 << 4)
+#define	SCAN_SQUOTE		(1 << 5)
+#define	SCAN_DASH		(1 << 6)
+#define	SCAN_NOT_SPACE	(1 << 7)	/* any byte that is not whitespace */
+
+
+typedef enum scan_level {
+	SCAN_SCALAR,
+	SCAN_SSE2,
+	SCAN_AVX2,
+	SCAN_AVX512
+} scan_level_t;
+
+
+/* bit i of each mask is set when byte i of a 64 byte block is in the class */
+typedef struct scan_masks {
+	uint64_t lt;
+	uint64_t gt;
+	uint64_t eq;
+	uint64_t space;
+	uint64_t dquote;
+	uint64_t squote;
+	uint64_t dash;
+} scan_masks_t;
+
+
+/* walks a buffer block by block, classifying each block once */
+typedef struct html_scanner {
+	const char * data;
+	size_t length;
+	size_t block;		/* offset of the block in masks */
+	bool valid;
+	scan_masks_t masks;
+} html_scanner_t;
+
+
+/*
+ * Classifies the 64 bytes at block with the implementation selected for
+ * this CPU. Every implementation produces the same masks as the scalar one.
+ */
+void
+html_classify(const char * block, scan_masks_t * masks);
+
+
+/*
+ * The implementation in use, the best one the CPU supports by default. The
+ * first call picks it, so calling it before starting threads keeps them
+ * from doing it while they scan.
+ */
+scan_level_t
+html_scan_level(void);
+
+
+/* forces an implementation, returns false if the CPU does not support it */
+bool
+html_scan_set_level(scan_level_t level);
+
+
+void
+html_scanner_init(html_scanner_t * scanner, const char * data, size_t length);
+
+
+/* classifies the block of the scanned buffer that starts at offset block */
+void
+html_scanner_load(html_scanner_t * scanner, size_t block);
+
+
+/*
+ * Returns the offset of the first byte at or after from that belongs to one
+ * of classes, or the length of the buffer if there is none. Inlined so the
+ * mask selection folds away for the constant classes of each call site.
+ */
+static inline size_t
+html_scanner_next(html_scanner_t * scanner, size_t from, int classes)
+{
+	size_t block, in_buffer;
+	uint64_t mask;
+
+	while (from < scanner->length) {
+		block = from & ~(size_t)(SCAN_BLOCK - 1);
+		if (!scanner->valid || scanner->block != block)
+			html_scanner_load(scanner, block);
+
+		mask = 0;
+		if (classes & SCAN_LT)
+			mask |= scanner->masks.lt;
+		if (classes & SCAN_GT)
+			mask |= scanner->masks.gt;
+		if (classes & SCAN_EQ)
+			mask |= scanner->masks.eq;
+		if (classes & SCAN_SPACE)
+			mask |= scanner->masks.space;
+		if (classes & SCAN_DQUOTE)
+			mask |= scanner->masks.dquote;
+		if (classes & SCAN_SQUOTE)
+			mask |= scanner->masks.squote;
+		if (classes & SCAN_DASH)
+			mask |= scanner->masks.dash;
+		if (classes & SCAN_NOT_SPACE)
+			mask |= ~scanner->masks.space;
+
+		in_buffer = scanner->length - block;
+		if (in_buffer < SCAN_BLOCK)
+			mask &= ((uint64_t)1 << in_buffer) - 1;
+		mask &= ~(uint64_t)0 << (from - block);
+
+		if (mask)
+			return block + __builtin_ctzll(mask);
+
+		from = block + SCAN_BLOCK;
+	}
+
+	return scanner->length;
+}
+
+
+#endif /* HTMLSCAN_H */
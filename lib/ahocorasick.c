@@ -0,0 +1,209 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "ahocorasick.h"
+
+
+static void
+assign_classes(ac_automaton_t * ac, int flags)
+{
+	unsigned char c;
+
+	memset(ac->class_of, 0, sizeof(ac->class_of));
+	ac->classes = 1;
+
+	for (int i = 0; i < ac->count; i++) {
+		for (size_t j = 0; j < ac->lengths[i]; j++) {
+			c = ac->patterns[i][j];
+
+			if ((flags & AC_IGNORE_CASE) && c >= 'A' && c <= 'Z')
+				c |= 0x20;
+
+			if (ac->class_of[c])
+				continue;
+
+			ac->class_of[c] = ac->classes;
+			if ((flags & AC_IGNORE_CASE) && c >= 'a' && c <= 'z')
+				ac->class_of[c & ~0x20] = ac->classes;
+			ac->classes++;
+		}
+	}
+}
+
+
+static void
+build_trie(ac_automaton_t * ac)
+{
+	uint32_t state, * next;
+
+	ac->num_states = 1;
+
+	for (int i = 0; i < ac->count; i++) {
+		state = AC_START;
+
+		// while building, a 0 transition means there is no edge: no edge of
+		// the trie points back to the root
+		for (size_t j = 0; j < ac->lengths[i]; j++) {
+			next = &ac->delta[state * ac->classes + ac->class_of[(unsigned char)ac->patterns[i][j]]];
+			if (!*next)
+				*next = ac->num_states++;
+			state = *next;
+		}
+
+		ac->next_own[i] = ac->own[state];
+		ac->own[state] = i;
+	}
+}
+
+
+/* breadth-first, fills in the failure transitions and dictionary links */
+static bool
+build_links(ac_automaton_t * ac)
+{
+	uint32_t * fail = calloc(ac->num_states, sizeof(uint32_t));
+	uint32_t * queue = malloc(ac->num_states * sizeof(uint32_t));
+	uint32_t head = 0, tail = 0, state, next, f;
+
+	if (!fail || !queue) {
+		free(fail);
+		free(queue);
+		return false;
+	}
+
+	ac->dict[AC_START] = -1;
+
+	for (int c = 0; c < ac->classes; c++) {
+		next = ac->delta[c];
+		if (next) {
+			fail[next] = AC_START;
+			ac->dict[next] = -1;
+			queue[tail++] = next;
+		}
+	}
+
+	while (head < tail) {
+		state = queue[head++];
+		f = fail[state];
+
+		for (int c = 0; c < ac->classes; c++) {
+			next = ac->delta[state * ac->classes + c];
+
+			if (!next) {
+				ac->delta[state * ac->classes + c] = ac->delta[f * ac->classes + c];
+				continue;
+			}
+
+			fail[next] = ac->delta[f * ac->classes + c];
+			ac->dict[next] = ac->own[fail[next]] >= 0 ? (int32_t)fail[next] : ac->dict[fail[next]];
+			queue[tail++] = next;
+		}
+	}
+
+	for (state = 0; state < ac->num_states; state++)
+		ac->matches[state] = ac->own[state] >= 0 || ac->dict[state] >= 0;
+
+	free(fail);
+	free(queue);
+
+	return true;
+}
+
+
+ac_automaton_t *
+ac_create(char * * patterns, int count, int flags)
+{
+	ac_automaton_t * ac = calloc(1, sizeof(ac_automaton_t));
+	size_t max_states = 1;
+
+	if (!ac) {
+		perror("Error");
+		return NULL;
+	}
+
+	ac->count = count;
+	ac->patterns = calloc(count, sizeof(char *));
+	ac->lengths = calloc(count, sizeof(size_t));
+	if (!ac->patterns || !ac->lengths)
+		goto error;
+
+	for (int i = 0; i < count; i++) {
+		if (!(ac->patterns[i] = strdup(patterns[i])))
+			goto error;
+		ac->lengths[i] = strlen(patterns[i]);
+		max_states += ac->lengths[i];
+	}
+
+	assign_classes(ac, flags);
+
+	ac->delta = calloc(max_states * ac->classes, sizeof(uint32_t));
+	ac->matches = calloc(max_states, sizeof(bool));
+	ac->own = malloc(max_states * sizeof(int));
+	ac->next_own = malloc(count * sizeof(int));
+	ac->dict = malloc(max_states * sizeof(int32_t));
+	if (!ac->delta || !ac->matches || !ac->own || !ac->next_own || !ac->dict)
+		goto error;
+
+	for (size_t i = 0; i < max_states; i++)
+		ac->own[i] = -1;
+
+	build_trie(ac);
+
+	if (!build_links(ac))
+		goto error;
+
+	return ac;
+
+error:
+	perror("Error");
+	ac_destroy(ac);
+	return NULL;
+}
+
+
+static bool
+report(const ac_automaton_t * ac, uint32_t state, size_t end, ac_match_function match_fn, void * userp)
+{
+	int32_t s = state;
+
+	for (; s >= 0; s = ac->dict[s])
+		for (int p = ac->own[s]; p >= 0; p = ac->next_own[p])
+			if (!match_fn(p, end, userp))
+				return false;
+
+	return true;
+}
+
+
+uint32_t
+ac_scan(const ac_automaton_t * ac, uint32_t state, const char * text, size_t length, ac_match_function match_fn, void * userp)
+{
+	const unsigned char * t = (const unsigned char *)text;
+
+	for (size_t i = 0; i < length; i++) {
+		state = ac->delta[state * ac->classes + ac->class_of[t[i]]];
+
+		if (ac->matches[state] && !report(ac, state, i + 1, match_fn, userp))
+			break;
+	}
+
+	return state;
+}
+
+
+void
+ac_destroy(ac_automaton_t * ac)
+{
+	if (ac->patterns)
+		for (int i = 0; i < ac->count; i++)
+			free(ac->patterns[i]);
+
+	free(ac->patterns);
+	free(ac->lengths);
+	free(ac->delta);
+	free(ac->matches);
+	free(ac->own);
+	free(ac->next_own);
+	free(ac->dict);
+	free(ac);
+}
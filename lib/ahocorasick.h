@@ -0,0 +1,56 @@
+#ifndef AHOCORASICK_H
+#define AHOCORASICK_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+
+#define	AC_START	0
+
+/* ASCII letters match regardless of case */
+#define	AC_IGNORE_CASE	(1 << 0)
+
+
+/* called for every occurrence, end is the offset right after it in text */
+typedef bool (*ac_match_function)(int pattern, size_t end, void * userp);
+
+
+/*
+ * Every pattern compiled into one deterministic automaton: each byte of the
+ * text costs one table lookup whatever the number of patterns. Read-only
+ * once created, so it can be shared by every thread.
+ */
+typedef struct ac_automaton {
+	int count;
+	char * * patterns;
+	size_t * lengths;
+	int classes;		/* bytes that appear in no pattern share class 0 */
+	uint8_t class_of[256];
+	uint32_t num_states;
+	uint32_t * delta;	/* num_states x classes transitions */
+	bool * matches;		/* the state ends at least one pattern */
+	int * own;		/* first pattern ending exactly at a state, -1 if none */
+	int * next_own;		/* next pattern ending at the same state */
+	int32_t * dict;		/* nearest suffix state that ends a pattern, -1 if none */
+} ac_automaton_t;
+
+
+ac_automaton_t *
+ac_create(char * * patterns, int count, int flags);
+
+
+/*
+ * Scans text starting from state, calling match_fn for every occurrence.
+ * Returns the state to resume from with the next part of the text, or
+ * stops early and returns the current state if match_fn returns false.
+ */
+uint32_t
+ac_scan(const ac_automaton_t * ac, uint32_t state, const char * text, size_t length, ac_match_function match_fn, void * userp);
+
+
+void
+ac_destroy(ac_automaton_t * ac);
+
+
+#endif /* AHOCORASICK_H */
@@ -0,0 +1,99 @@
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "arena.h"
+
+
+#define LOCK(lock)		pthread_mutex_lock(&lock);
+#define UNLOCK(lock)	pthread_mutex_unlock(&lock);
+
+
+static arena_chunk_t *
+chunk_create(size_t size, arena_chunk_t * next)
+{
+	arena_chunk_t * chunk = malloc(sizeof(arena_chunk_t) + size);
+
+	if (!chunk) {
+		perror("Error");
+		return NULL;
+	}
+
+	chunk->next = next;
+	chunk->size = size;
+	chunk->used = 0;
+
+	return chunk;
+}
+
+
+arena_t *
+arena_create(void)
+{
+	arena_t * arena = calloc(1, sizeof(arena_t));
+
+	if (!arena) {
+		perror("Error");
+		return NULL;
+	}
+
+	if (!(arena->chunk = chunk_create(ARENA_CHUNK, NULL))) {
+		free(arena);
+		return NULL;
+	}
+
+	pthread_mutex_init(&arena->lock, NULL);
+	arena->memory = ARENA_CHUNK;
+
+	return arena;
+}
+
+
+void *
+arena_alloc(arena_t * arena, size_t size)
+{
+	arena_chunk_t * chunk, * next;
+	size_t offset;
+
+	size = (size + ARENA_ALIGN - 1) & ~(size_t)(ARENA_ALIGN - 1);
+
+	for (;;) {
+		chunk = __atomic_load_n(&arena->chunk, __ATOMIC_ACQUIRE);
+		offset = __atomic_fetch_add(&chunk->used, size, __ATOMIC_RELAXED);
+		if (offset + size <= chunk->size)
+			return chunk->data + offset;
+
+		// the rest of a full chunk is left unused
+		LOCK(arena->lock);
+		if (arena->chunk == chunk) {
+			if (!(next = chunk_create(size > ARENA_CHUNK ? size : ARENA_CHUNK, chunk))) {
+				UNLOCK(arena->lock);
+				return NULL;
+			}
+			arena->memory += next->size;
+			__atomic_store_n(&arena->chunk, next, __ATOMIC_RELEASE);
+		}
+		UNLOCK(arena->lock);
+	}
+}
+
+
+size_t
+arena_memory(arena_t * arena)
+{
+	return arena->memory;
+}
+
+
+void
+arena_destroy(arena_t * arena)
+{
+	arena_chunk_t * chunk, * next;
+
+	for (chunk = arena->chunk; chunk; chunk = next) {
+		next = chunk->next;
+		free(chunk);
+	}
+
+	pthread_mutex_destroy(&arena->lock);
+	free(arena);
+}
@@ -0,0 +1,53 @@
+#ifndef ARENA_H
+#define ARENA_H
+
+#include <pthread.h>
+#include <stddef.h>
+
+
+#define	ARENA_CHUNK		(1 << 20)	/* bytes allocated at once, unless an object needs more */
+#define	ARENA_ALIGN		8
+
+
+typedef struct arena_chunk {
+	struct arena_chunk * next;	/* older chunk */
+	size_t size;
+	size_t used;		/* may run past size by the allocations that did not fit */
+	char data[] __attribute__((aligned(ARENA_ALIGN)));
+} arena_chunk_t;
+
+
+/*
+ * Memory for objects that live as long as the arena: each allocation bumps
+ * an offset in the newest chunk, so it costs an atomic add and no header,
+ * and they are all freed at once by arena_destroy(). The lock is only
+ * taken to start a new chunk.
+ *
+ * Allocations may run concurrently from any thread.
+ */
+typedef struct arena {
+	arena_chunk_t * chunk;	/* newest */
+	pthread_mutex_t lock;
+	size_t memory;			/* of all chunks */
+} arena_t;
+
+
+arena_t *
+arena_create(void);
+
+
+/* ARENA_ALIGN aligned, NULL if out of memory */
+void *
+arena_alloc(arena_t * arena, size_t size);
+
+
+/* bytes taken by the chunks, not synchronized */
+size_t
+arena_memory(arena_t * arena);
+
+
+void
+arena_destroy(arena_t * arena);
+
+
+#endif /* ARENA_H */
@@ -0,0 +1,145 @@
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "bloom.h"
+
+
+bloom_t *
+bloom_create(size_t expected, double fp_rate)
+{
+	bloom_t * filter;
+	double n = expected < 1 ? 1 : expected, bits;
+
+	if (fp_rate <= 0 || fp_rate >= 1) {
+		fprintf(stderr, "Error: false positive rate must be between 0 and 1\n");
+		return NULL;
+	}
+
+	filter = calloc(1, sizeof(bloom_t));
+	if (!filter) {
+		perror("Error");
+		return NULL;
+	}
+
+	// the optimal classic filter has -ln(p) / ln(2)^2 bits per element and
+	// ln(2) bits per element set for each of them
+	bits = n * -log(fp_rate) / (M_LN2 * M_LN2);
+	filter->num_blocks = (size_t)ceil(bits / BLOOM_BLOCK_BITS);
+	filter->hashes = (int)lround(bits / n * M_LN2);
+	if (filter->hashes < 1)
+		filter->hashes = 1;
+	else if (filter->hashes > BLOOM_MAX_HASHES)
+		filter->hashes = BLOOM_MAX_HASHES;
+
+	if (posix_memalign((void**)&filter->blocks, 64, filter->num_blocks * sizeof(bloom_block_t))) {
+		perror("Error");
+		free(filter);
+		return NULL;
+	}
+	memset(filter->blocks, 0, filter->num_blocks * sizeof(bloom_block_t));
+
+	return filter;
+}
+
+
+static inline bloom_block_t *
+get_block(bloom_t * filter, uint64_t hash)
+{
+	// maps the high half onto [0, num_blocks) without a division
+	return &filter->blocks[((hash >> 32) * filter->num_blocks) >> 32];
+}
+
+
+/*
+ * The bits within the block come from double hashing the low half of the
+ * hash, the top 9 bits of each step index the block's 512 bits.
+ */
+static inline uint32_t
+bit_step(uint64_t hash)
+{
+	return (uint32_t)((hash * 0x9E3779B97F4A7C15ULL) >> 32) | 1;
+}
+
+
+bool
+bloom_add(bloom_t * filter, uint64_t hash)
+{
+	bloom_block_t * block = get_block(filter, hash);
+	uint32_t bit = (uint32_t)hash, step = bit_step(hash);
+	uint64_t mask, old;
+	bool added = false;
+
+	for (int i = 0; i < filter->hashes; i++, bit += step) {
+		mask = 1ULL << ((bit >> 23) & 63);
+		// most bits are already set once the filter fills up, testing
+		// first avoids dirtying the cache line for them
+		if (__atomic_load_n(&block->words[bit >> 29], __ATOMIC_RELAXED) & mask)
+			continue;
+
+		old = __atomic_fetch_or(&block->words[bit >> 29], mask, __ATOMIC_RELAXED);
+		added |= !(old & mask);
+	}
+
+	return added;
+}
+
+
+bool
+bloom_contains(bloom_t * filter, uint64_t hash)
+{
+	bloom_block_t * block = get_block(filter, hash);
+	uint32_t bit = (uint32_t)hash, step = bit_step(hash);
+
+	for (int i = 0; i < filter->hashes; i++, bit += step)
+		if (!(__atomic_load_n(&block->words[bit >> 29], __ATOMIC_RELAXED) & (1ULL << ((bit >> 23) & 63))))
+			return false;
+
+	return true;
+}
+
+
+void
+bloom_prefetch(bloom_t * filter, uint64_t hash)
+{
+	__builtin_prefetch(get_block(filter, hash), 1);
+}
+
+
+size_t
+bloom_memory(bloom_t * filter)
+{
+	return sizeof(bloom_t) + filter->num_blocks * sizeof(bloom_block_t);
+}
+
+
+/*
+ * A lookup is a false positive when all its bits happen to be set in the
+ * block it lands on, so the rate is the average of every block's fill to the
+ * power of the number of bits.
+ */
+double
+bloom_fp_rate(bloom_t * filter)
+{
+	double sum = 0;
+	int set;
+
+	for (size_t i = 0; i < filter->num_blocks; i++) {
+		set = 0;
+		for (int j = 0; j < BLOOM_BLOCK_WORDS; j++)
+			set += __builtin_popcountll(filter->blocks[i].words[j]);
+
+		sum += pow((double)set / BLOOM_BLOCK_BITS, filter->hashes);
+	}
+
+	return sum / filter->num_blocks;
+}
+
+
+void
+bloom_destroy(bloom_t * filter)
+{
+	free(filter->blocks);
+	free(filter);
+}
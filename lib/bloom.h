@@ -0,0 +1,70 @@
+#ifndef BLOOM_H
+#define BLOOM_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+
+#define	BLOOM_BLOCK_WORDS	8	/* a block is one 64 byte cache line */
+#define	BLOOM_BLOCK_BITS	(BLOOM_BLOCK_WORDS * 64)
+#define	BLOOM_MAX_HASHES	16
+
+
+typedef struct bloom_block {
+	uint64_t words[BLOOM_BLOCK_WORDS];
+} __attribute__((aligned(64))) bloom_block_t;
+
+
+/*
+ * A blocked Bloom filter over 64-bit hashes. The high half of a hash picks a
+ * block and the low half the bits set within it, so a lookup touches a single
+ * cache line. It costs a little more memory than a classic filter for the
+ * same false positive rate.
+ *
+ * Adds and lookups may run concurrently from any thread.
+ */
+typedef struct bloom {
+	bloom_block_t * blocks;
+	size_t num_blocks;
+	int hashes;		/* bits set per element */
+} bloom_t;
+
+
+/* sized so that expected elements give about fp_rate false positives */
+bloom_t *
+bloom_create(size_t expected, double fp_rate);
+
+
+/*
+ * Returns true if some bit of hash was not set yet, which means it was not in
+ * the filter. Two threads adding the same hash at once may both see true.
+ */
+bool
+bloom_add(bloom_t * filter, uint64_t hash);
+
+
+/* false means hash was never added, true that it probably was */
+bool
+bloom_contains(bloom_t * filter, uint64_t hash);
+
+
+/* starts loading the block of hash, ahead of an add or lookup */
+void
+bloom_prefetch(bloom_t * filter, uint64_t hash);
+
+
+size_t
+bloom_memory(bloom_t * filter);
+
+
+/* false positive rate for the current fill, not synchronized with adds */
+double
+bloom_fp_rate(bloom_t * filter);
+
+
+void
+bloom_destroy(bloom_t * filter);
+
+
+#endif /* BLOOM_H */
@@ -0,0 +1,730 @@
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "checkpoint.h"
+#include "futex.h"
+
+
+#define LOCK(lock)		pthread_mutex_lock(&lock);
+#define UNLOCK(lock)	pthread_mutex_unlock(&lock);
+
+#define	LOG_BUFFER		(1 << 20)	/* stdio buffer of the log */
+#define	SNAPSHOT_MAGIC	"CRAWLCP2"
+#define	MERGE_RATIO		2			/* a log is merged once it is 1/MERGE_RATIO of the snapshot */
+
+#define	RECORD_QUEUED	1	/* hash, score and url of a queued url */
+#define	RECORD_DONE		2	/* hash of a url that left the frontier */
+#define	RECORD_MATCH	3	/* a match as the crawler saved it */
+
+
+/* every record of a log and of a snapshot */
+typedef struct record {
+	uint32_t type;
+	uint32_t length;		/* of what follows */
+} record_t;
+
+
+/* followed by the pending urls and the matches as records */
+typedef struct snapshot_header {
+	char magic[8];
+	uint64_t visited;		/* hashes of the visited file that belong to this snapshot */
+} snapshot_header_t;
+
+
+typedef struct mapping {
+	const char * data;		/* NULL if the file is missing or empty */
+	size_t size;
+} mapping_t;
+
+
+/* the queued urls of the logs being merged that were not fetched yet */
+typedef struct pending_set {
+	uint64_t * hashes;
+	const char * * records;	/* NULL once the url was done */
+	size_t count;
+	size_t allocated;
+	size_t * slots;			/* index + 1 of a url, 0 if empty */
+	size_t mask;
+} pending_set_t;
+
+
+static void
+path_of(checkpoint_t * checkpoint, const char * name, char * path)
+{
+	snprintf(path, PATH_MAX, "%s/%s", checkpoint->dir, name);
+}
+
+
+/* maps a whole file read-only, a missing file maps to nothing */
+static bool
+map_file(const char * path, mapping_t * map)
+{
+	struct stat st;
+	void * data;
+	int fd;
+
+	map->data = NULL;
+	map->size = 0;
+
+	if ((fd = open(path, O_RDONLY)) == -1) {
+		if (errno == ENOENT)
+			return true;
+		perror(path);
+		return false;
+	}
+
+	if (fstat(fd, &st) == -1) {
+		perror(path);
+		close(fd);
+		return false;
+	}
+
+	if (st.st_size > 0) {
+		if ((data = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0)) == MAP_FAILED) {
+			perror(path);
+			close(fd);
+			return false;
+		}
+		madvise(data, st.st_size, MADV_SEQUENTIAL);
+		map->data = data;
+		map->size = st.st_size;
+	}
+
+	close(fd);
+	return true;
+}
+
+
+static void
+unmap_file(mapping_t * map)
+{
+	if (map->data)
+		munmap((void *)map->data, map->size);
+}
+
+
+/*
+ * Returns the record at *p and moves past it, or NULL at the end. A record
+ * cut short by a crash ends the log there.
+ */
+static const char *
+next_record(const char * * p, const char * end, record_t * record)
+{
+	const char * start = *p;
+
+	if ((size_t)(end - start) < sizeof(record_t))
+		return NULL;
+
+	memcpy(record, start, sizeof(record_t));
+	if (record->length > (size_t)(end - start) - sizeof(record_t))
+		return NULL;
+
+	*p = start + sizeof(record_t) + record->length;
+	return start;
+}
+
+
+static inline uint64_t
+record_hash(const char * record)
+{
+	uint64_t hash;
+
+	memcpy(&hash, record + sizeof(record_t), sizeof(hash));
+	return hash;
+}
+
+
+/* the records of a snapshot, after its header */
+static const char *
+snapshot_records(mapping_t * snapshot, const char * path, snapshot_header_t * header)
+{
+	if (snapshot->size < sizeof(*header))
+		goto invalid;
+
+	memcpy(header, snapshot->data, sizeof(*header));
+	if (memcmp(header->magic, SNAPSHOT_MAGIC, sizeof(header->magic)))
+		goto invalid;
+
+	return snapshot->data + sizeof(*header);
+
+invalid:
+	fprintf(stderr, "%s is not a checkpoint snapshot.\n", path);
+	return NULL;
+}
+
+
+/* the file is flushed, now the rename that made it current is too */
+static void
+sync_dir(checkpoint_t * checkpoint)
+{
+	int fd = open(checkpoint->dir, O_RDONLY | O_DIRECTORY);
+
+	if (fd == -1 || fsync(fd) == -1)
+		perror(checkpoint->dir);
+	if (fd != -1)
+		close(fd);
+}
+
+
+/*
+ * Appends the hashes the logs queued to the visited file, behind the count
+ * hashes of the current snapshot, and adds them to count. Whatever a merge
+ * that died appended after those is cut first; the file is only read up to
+ * the count of the snapshot that replaced the old one, so it grows by the
+ * logs alone instead of being written again.
+ */
+static bool
+append_visited(checkpoint_t * checkpoint, mapping_t * logs, int num_logs, uint64_t * count)
+{
+	char path[PATH_MAX];
+	const char * p, * end, * r;
+	record_t record;
+	uint64_t hash, added = 0;
+	struct stat st;
+	FILE * file;
+	int fd;
+
+	path_of(checkpoint, "visited", path);
+	if ((fd = open(path, O_WRONLY | O_CREAT, 0666)) == -1 || fstat(fd, &st) == -1) {
+		perror(path);
+		if (fd != -1)
+			close(fd);
+		return false;
+	}
+
+	if ((uint64_t)st.st_size < *count * sizeof(uint64_t)) {
+		fprintf(stderr, "%s is shorter than its snapshot.\n", path);
+		close(fd);
+		return false;
+	}
+
+	if (ftruncate(fd, *count * sizeof(uint64_t)) == -1 || lseek(fd, 0, SEEK_END) == -1 ||
+			!(file = fdopen(fd, "w"))) {
+		perror(path);
+		close(fd);
+		return false;
+	}
+	setvbuf(file, NULL, _IOFBF, LOG_BUFFER);
+
+	for (int i = 0; i < num_logs; i++) {
+		for (p = logs[i].data, end = p + logs[i].size; p && (r = next_record(&p, end, &record)); ) {
+			if (record.type == RECORD_QUEUED) {
+				hash = record_hash(r);
+				fwrite(&hash, sizeof(hash), 1, file);
+				added++;
+			}
+		}
+	}
+
+	if (fflush(file) == EOF || ferror(file) || fsync(fd) == -1) {
+		perror(path);
+		fclose(file);
+		return false;
+	}
+	fclose(file);
+
+	*count += added;
+	return true;
+}
+
+
+static bool
+pending_grow(pending_set_t * set)
+{
+	size_t capacity = set->mask ? (set->mask + 1) * 2 : 1024, * slots, j;
+
+	if (!(slots = calloc(capacity, sizeof(size_t)))) {
+		perror("Error");
+		return false;
+	}
+
+	for (size_t i = 0; i < set->count; i++) {
+		for (j = set->hashes[i] & (capacity - 1); slots[j]; j = (j + 1) & (capacity - 1))
+			;
+		slots[j] = i + 1;
+	}
+
+	free(set->slots);
+	set->slots = slots;
+	set->mask = capacity - 1;
+
+	return true;
+}
+
+
+static bool
+pending_add(pending_set_t * set, const char * record)
+{
+	uint64_t hash = record_hash(record), * hashes;
+	const char * * records;
+	size_t j;
+
+	if (set->count == set->allocated) {
+		set->allocated = set->allocated ? set->allocated * 2 : 1024;
+		hashes = realloc(set->hashes, set->allocated * sizeof(uint64_t));
+		if (hashes)
+			set->hashes = hashes;
+		records = realloc(set->records, set->allocated * sizeof(char *));
+		if (records)
+			set->records = records;
+		if (!hashes || !records) {
+			perror("Error");
+			return false;
+		}
+	}
+
+	if ((set->count + 1) * 2 > set->mask + 1 && !pending_grow(set))
+		return false;
+
+	for (j = hash & set->mask; set->slots[j]; j = (j + 1) & set->mask)
+		;
+	set->slots[j] = set->count + 1;
+	set->hashes[set->count] = hash;
+	set->records[set->count++] = record;
+
+	return true;
+}
+
+
+static void
+pending_remove(pending_set_t * set, uint64_t hash)
+{
+	size_t i;
+
+	if (!set->slots)
+		return;
+
+	for (size_t j = hash & set->mask; set->slots[j]; j = (j + 1) & set->mask) {
+		i = set->slots[j] - 1;
+		if (set->hashes[i] == hash && set->records[i]) {
+			set->records[i] = NULL;
+			return;
+		}
+	}
+}
+
+
+static void
+pending_free(pending_set_t * set)
+{
+	free(set->hashes);
+	free(set->records);
+	free(set->slots);
+}
+
+
+/*
+ * Merges logs, oldest first, into the snapshot: the hashes of the urls
+ * they queued are appended to the visited file, the urls they queued join
+ * the pending ones unless they were done, and their matches follow the
+ * matches saved. Only the pending urls and the matches are written again,
+ * so a merge costs the size of the frontier, not of the visited set. Only
+ * files are read, so the crawl goes on meanwhile. The logs are removed
+ * once the new snapshot replaced the old one.
+ */
+static bool
+compact(checkpoint_t * checkpoint, const char * * logs, int num_logs)
+{
+	mapping_t snapshot, maps[num_logs];
+	pending_set_t pending = { 0 };
+	snapshot_header_t header = { SNAPSHOT_MAGIC, 0 };
+	char path[PATH_MAX], temporary[PATH_MAX];
+	const char * records = NULL, * p, * end, * r;
+	record_t record;
+	FILE * out = NULL;
+	bool ok = false;
+	int i, mapped = 0;
+
+	path_of(checkpoint, "snapshot", path);
+
+	if (!map_file(path, &snapshot))
+		return false;
+	if (snapshot.data && !(records = snapshot_records(&snapshot, path, &header)))
+		goto out;
+
+	for (; mapped < num_logs; mapped++) {
+		path_of(checkpoint, logs[mapped], temporary);
+		if (!map_file(temporary, &maps[mapped]))
+			goto out;
+	}
+
+	for (i = 0; i < num_logs && !maps[i].data; i++)
+		;
+	if (!snapshot.data && i == num_logs)
+		goto remove_logs;	/* nothing saved yet */
+	path_of(checkpoint, "snapshot.new", temporary);
+
+	// what is still pending at the end of the last log
+	if (records)
+		for (p = records, end = snapshot.data + snapshot.size; (r = next_record(&p, end, &record)); )
+			if (record.type == RECORD_QUEUED && !pending_add(&pending, r))
+				goto out;
+	for (i = 0; i < num_logs; i++) {
+		for (p = maps[i].data, end = p + maps[i].size; p && (r = next_record(&p, end, &record)); ) {
+			if (record.type == RECORD_QUEUED) {
+				if (!pending_add(&pending, r))
+					goto out;
+			} else if (record.type == RECORD_DONE) {
+				pending_remove(&pending, record_hash(r));
+			}
+		}
+	}
+
+	if (!append_visited(checkpoint, maps, num_logs, &header.visited))
+		goto out;
+
+	if (!(out = fopen(temporary, "w"))) {
+		perror(temporary);
+		goto out;
+	}
+	setvbuf(out, NULL, _IOFBF, LOG_BUFFER);
+
+	fwrite(&header, sizeof(header), 1, out);
+	for (size_t j = 0; j < pending.count; j++) {
+		if (pending.records[j]) {
+			memcpy(&record, pending.records[j], sizeof(record));
+			fwrite(pending.records[j], 1, sizeof(record) + record.length, out);
+		}
+	}
+
+	if (records)
+		for (p = records, end = snapshot.data + snapshot.size; (r = next_record(&p, end, &record)); )
+			if (record.type == RECORD_MATCH)
+				fwrite(r, 1, sizeof(record) + record.length, out);
+	for (i = 0; i < num_logs; i++)
+		for (p = maps[i].data, end = p + maps[i].size; p && (r = next_record(&p, end, &record)); )
+			if (record.type == RECORD_MATCH)
+				fwrite(r, 1, sizeof(record) + record.length, out);
+
+	// the old snapshot is only replaced by a complete new one
+	if (fflush(out) == EOF || ferror(out) || fsync(fileno(out)) == -1) {
+		perror(temporary);
+		goto out;
+	}
+	if (rename(temporary, path) == -1) {
+		perror(path);
+		goto out;
+	}
+	sync_dir(checkpoint);
+
+remove_logs:
+	for (i = 0; i < num_logs; i++) {
+		path_of(checkpoint, logs[i], temporary);
+		unlink(temporary);
+	}
+	ok = true;
+
+out:
+	if (out) {
+		fclose(out);
+		if (!ok)
+			unlink(temporary);
+	}
+	for (i = 0; i < mapped; i++)
+		unmap_file(&maps[i]);
+	unmap_file(&snapshot);
+	pending_free(&pending);
+
+	return ok;
+}
+
+
+/*
+ * Maps the snapshot and hands its contents to the handlers, the visited
+ * hashes at once as they are in the visited file. A pending url the
+ * handler could not queue is marked done in the log.
+ */
+static bool
+load(checkpoint_t * checkpoint, const checkpoint_handlers_t * handlers)
+{
+	mapping_t snapshot, visited = { NULL, 0 };
+	snapshot_header_t header;
+	char path[PATH_MAX];
+	const char * records, * p, * end, * r;
+	uint64_t hash;
+	record_t record;
+	float score;
+
+	path_of(checkpoint, "snapshot", path);
+	if (!map_file(path, &snapshot))
+		return false;
+
+	if (!snapshot.data) {
+		fprintf(stderr, "No checkpoint to resume in %s.\n", checkpoint->dir);
+		return false;
+	}
+
+	if (!(records = snapshot_records(&snapshot, path, &header)))
+		goto fail;
+
+	path_of(checkpoint, "visited", path);
+	if (!map_file(path, &visited))
+		goto fail;
+	if (visited.size / sizeof(uint64_t) < header.visited) {
+		fprintf(stderr, "%s is shorter than its snapshot.\n", path);
+		goto fail;
+	}
+	handlers->visited((const uint64_t *)visited.data, header.visited, handlers->userp);
+	unmap_file(&visited);
+
+	for (p = records, end = snapshot.data + snapshot.size; (r = next_record(&p, end, &record)); ) {
+		r += sizeof(record);
+		if (record.type == RECORD_QUEUED) {
+			memcpy(&hash, r, sizeof(hash));
+			memcpy(&score, r + sizeof(hash), sizeof(score));
+			if (!handlers->pending(r + sizeof(hash) + sizeof(score), record.length - sizeof(hash) - sizeof(score),
+					score, handlers->userp))
+				checkpoint_done(checkpoint, hash);
+		} else if (record.type == RECORD_MATCH) {
+			handlers->match(r, record.length, handlers->userp);
+		}
+	}
+
+	unmap_file(&snapshot);
+	return true;
+
+fail:
+	unmap_file(&visited);
+	unmap_file(&snapshot);
+	return false;
+}
+
+
+static FILE *
+open_log(const char * path)
+{
+	FILE * log = fopen(path, "w");
+
+	if (!log) {
+		perror(path);
+		return NULL;
+	}
+	setvbuf(log, NULL, _IOFBF, LOG_BUFFER);
+
+	return log;
+}
+
+
+checkpoint_t *
+checkpoint_open(const char * dir, const checkpoint_handlers_t * handlers)
+{
+	checkpoint_t * checkpoint = calloc(1, sizeof(checkpoint_t));
+	const char * logs[] = { "log.old", "log" };
+	char path[PATH_MAX];
+
+	if (!checkpoint || !(checkpoint->dir = strdup(dir))) {
+		perror("Error");
+		free(checkpoint);
+		return NULL;
+	}
+
+	if (mkdir(dir, 0777) == -1 && errno != EEXIST) {
+		perror(dir);
+		goto fail;
+	}
+
+	if (handlers) {
+		// logs a crash left behind are folded in first
+		if (!compact(checkpoint, logs, 2))
+			goto fail;
+	} else {
+		path_of(checkpoint, "snapshot", path);
+		unlink(path);
+		path_of(checkpoint, "visited", path);
+		unlink(path);
+		path_of(checkpoint, "log.old", path);
+		unlink(path);
+	}
+
+	path_of(checkpoint, "log", path);
+	if (!(checkpoint->log = open_log(path)))
+		goto fail;
+
+	pthread_mutex_init(&checkpoint->lock, NULL);
+	checkpoint->interval = CHECKPOINT_INTERVAL;
+
+	// the log is open so urls that cannot be queued again are marked done
+	if (handlers && !load(checkpoint, handlers)) {
+		fclose(checkpoint->log);
+		pthread_mutex_destroy(&checkpoint->lock);
+		goto fail;
+	}
+
+	return checkpoint;
+
+fail:
+	free(checkpoint->dir);
+	free(checkpoint);
+	return NULL;
+}
+
+
+/*
+ * Moves the log aside and merges it into the snapshot. Workers only wait
+ * for the rename: the old log is written and merged after they moved on to
+ * the new one. A log.old that a failed merge left is merged first.
+ *
+ * A merge writes the whole frontier again, so it waits until the log grew
+ * to a share of the snapshot: the merges then cost a few times what the
+ * log cost to write, however large the frontier is.
+ */
+static void
+take_snapshot(checkpoint_t * checkpoint)
+{
+	const char * logs[] = { "log.old" };
+	char path[PATH_MAX], old_path[PATH_MAX], snapshot_path[PATH_MAX];
+	struct stat log_stat, snapshot_stat;
+	FILE * old, * log;
+
+	path_of(checkpoint, "log", path);
+	path_of(checkpoint, "log.old", old_path);
+	path_of(checkpoint, "snapshot", snapshot_path);
+
+	if (access(old_path, F_OK) == 0) {
+		compact(checkpoint, logs, 1);
+		return;
+	}
+
+	if (stat(path, &log_stat) == 0 && stat(snapshot_path, &snapshot_stat) == 0 &&
+			log_stat.st_size < snapshot_stat.st_size / MERGE_RATIO)
+		return;
+
+	LOCK(checkpoint->lock);
+
+	if (rename(path, old_path) == -1) {
+		perror(path);
+		UNLOCK(checkpoint->lock);
+		return;
+	}
+	if (!(log = open_log(path))) {
+		rename(old_path, path);
+		UNLOCK(checkpoint->lock);
+		return;
+	}
+	old = checkpoint->log;
+	checkpoint->log = log;
+
+	UNLOCK(checkpoint->lock);
+
+	if (fclose(old) == EOF) {
+		perror(old_path);
+		return;
+	}
+	compact(checkpoint, logs, 1);
+}
+
+
+static void *
+run(void * data)
+{
+	checkpoint_t * checkpoint = (checkpoint_t *)data;
+	time_t last = time(NULL);
+	int error;
+
+	while (!__atomic_load_n(&checkpoint->stop, __ATOMIC_ACQUIRE)) {
+		futex_wait(&checkpoint->stop, 0, CHECKPOINT_FLUSH);
+
+		LOCK(checkpoint->lock);
+		error = fflush(checkpoint->log) == EOF;
+		UNLOCK(checkpoint->lock);
+		if (error)
+			perror("Error");
+
+		if (time(NULL) - last >= checkpoint->interval) {
+			take_snapshot(checkpoint);
+			last = time(NULL);
+		}
+	}
+
+	return NULL;
+}
+
+
+bool
+checkpoint_start(checkpoint_t * checkpoint, int interval)
+{
+	checkpoint->interval = interval;
+
+	if ((errno = pthread_create(&checkpoint->thread, NULL, run, checkpoint))) {
+		perror("Error");
+		return false;
+	}
+	checkpoint->running = true;
+
+	return true;
+}
+
+
+void
+checkpoint_queued(checkpoint_t * checkpoint, url_t * * urls, const float * scores, size_t count)
+{
+	record_t record = { RECORD_QUEUED, 0 };
+	float score;
+
+	LOCK(checkpoint->lock);
+
+	for (size_t i = 0; i < count; i++) {
+		record.length = sizeof(uint64_t) + sizeof(float) + urls[i]->length;
+		score = scores ? scores[i] : 0;
+		fwrite(&record, sizeof(record), 1, checkpoint->log);
+		fwrite(&urls[i]->hash, sizeof(uint64_t), 1, checkpoint->log);
+		fwrite(&score, sizeof(score), 1, checkpoint->log);
+		fwrite(urls[i]->str, 1, urls[i]->length, checkpoint->log);
+	}
+
+	UNLOCK(checkpoint->lock);
+}
+
+
+void
+checkpoint_done(checkpoint_t * checkpoint, uint64_t url_hash)
+{
+	record_t record = { RECORD_DONE, sizeof(uint64_t) };
+
+	LOCK(checkpoint->lock);
+	fwrite(&record, sizeof(record), 1, checkpoint->log);
+	fwrite(&url_hash, sizeof(url_hash), 1, checkpoint->log);
+	UNLOCK(checkpoint->lock);
+}
+
+
+void
+checkpoint_match(checkpoint_t * checkpoint, const void * data, size_t length)
+{
+	record_t record = { RECORD_MATCH, length };
+
+	LOCK(checkpoint->lock);
+	fwrite(&record, sizeof(record), 1, checkpoint->log);
+	fwrite(data, 1, length, checkpoint->log);
+	UNLOCK(checkpoint->lock);
+}
+
+
+void
+checkpoint_close(checkpoint_t * checkpoint)
+{
+	const char * logs[] = { "log.old", "log" };
+
+	if (checkpoint->running) {
+		__atomic_store_n(&checkpoint->stop, 1, __ATOMIC_RELEASE);
+		futex_wake(&checkpoint->stop, 1);
+		pthread_join(checkpoint->thread, NULL);
+	}
+
+	if (fclose(checkpoint->log) == EOF)
+		perror("Error");
+	else
+		compact(checkpoint, logs, 2);
+
+	pthread_mutex_destroy(&checkpoint->lock);
+	free(checkpoint->dir);
+	free(checkpoint);
+}
@@ -0,0 +1,96 @@
+#ifndef CHECKPOINT_H
+#define CHECKPOINT_H
+
+#include <pthread.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+
+#include "url.h"
+
+
+#define	CHECKPOINT_INTERVAL	60		/* default seconds between snapshots */
+#define	CHECKPOINT_FLUSH	1000	/* ms records may wait in memory before they reach the log */
+
+
+/*
+ * Called with what a checkpoint that is loaded holds: visited once with
+ * every visited hash, which stay mapped only until it returns, and pending
+ * for every url still to fetch, returning false if it could not be queued.
+ */
+typedef struct checkpoint_handlers {
+	void (*visited)(const uint64_t * hashes, size_t count, void * userp);
+	bool (*pending)(const char * url, size_t length, float score, void * userp);
+	void (*match)(const void * data, size_t length, void * userp);
+	void * userp;
+} checkpoint_handlers_t;
+
+
+/*
+ * The state of a crawl kept on disk, so that a crawl that dies resumes
+ * where it was instead of from the seed. Workers append what changes to a
+ * log: the urls they queue, the urls that were fetched and the matches.
+ * The visited set is every url ever queued, the frontier the queued urls
+ * that were not fetched yet.
+ *
+ * Every interval, once the log grew to a share of the snapshot, a thread
+ * moves the log aside, so workers go on appending to a new one, and merges
+ * the old log into a new snapshot of the pending urls and the matches,
+ * written from the previous snapshot and the log alone without looking at
+ * the crawl. The visited hashes only grow, so they are appended to a file
+ * of their own, and the snapshot says how many of them it covers. Resuming
+ * merges whatever logs are left the same way and maps both files to load
+ * them.
+ *
+ * The log is written every CHECKPOINT_FLUSH ms, so a crash loses at most
+ * that much of the crawl, and at worst fetches some pages again.
+ *
+ * Files in dir: snapshot, visited, log and log.old while a merge runs.
+ */
+typedef struct checkpoint {
+	pthread_mutex_t lock;	/* of log */
+	char * dir;
+	FILE * log;
+	int interval;			/* seconds */
+	pthread_t thread;
+	bool running;
+	uint32_t stop;			/* futex the thread sleeps on */
+} checkpoint_t;
+
+
+/*
+ * Opens the checkpoint in dir, creating dir if needed. With handlers, the
+ * saved state is loaded through them first; without, any saved state is
+ * removed and the crawl starts over.
+ */
+checkpoint_t *
+checkpoint_open(const char * dir, const checkpoint_handlers_t * handlers);
+
+
+/* starts the thread that writes the log and checks every interval seconds whether to take a snapshot */
+bool
+checkpoint_start(checkpoint_t * checkpoint, int interval);
+
+
+/* urls that were claimed and are about to be queued, scores may be NULL for all 0 */
+void
+checkpoint_queued(checkpoint_t * checkpoint, url_t * * urls, const float * scores, size_t count);
+
+
+/* a url that left the frontier for good: it was fetched or dropped */
+void
+checkpoint_done(checkpoint_t * checkpoint, uint64_t url_hash);
+
+
+/* a match, saved as is */
+void
+checkpoint_match(checkpoint_t * checkpoint, const void * data, size_t length);
+
+
+/* stops the thread and leaves a single snapshot behind */
+void
+checkpoint_close(checkpoint_t * checkpoint);
+
+
+#endif /* CHECKPOINT_H */
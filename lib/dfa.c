@@ -0,0 +1,1003 @@
+#define _GNU_SOURCE
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "dfa.h"
+
+
+#define	RE_MAX_REPEAT	255
+#define	RE_MAX_DEPTH	256
+#define	NFA_MAX_STATES	(1 << 16)
+
+
+/* ------------------------------------------------------------------------- */
+/* byte sets                                                                 */
+
+static inline void
+set_add(uint64_t * set, unsigned char c)
+{
+	set[c >> 6] |= (uint64_t)1 << (c & 63);
+}
+
+
+static inline bool
+set_has(const uint64_t * set, unsigned char c)
+{
+	return set[c >> 6] & ((uint64_t)1 << (c & 63));
+}
+
+
+static void
+set_range(uint64_t * set, unsigned char from, unsigned char to)
+{
+	for (int c = from; c <= to; c++)
+		set_add(set, c);
+}
+
+
+static void
+set_invert(uint64_t * set)
+{
+	for (int i = 0; i < 4; i++)
+		set[i] = ~set[i];
+}
+
+
+/* adds the other case of every ASCII letter of the set */
+static void
+set_fold(uint64_t * set)
+{
+	for (int c = 'a'; c <= 'z'; c++) {
+		if (set_has(set, c) || set_has(set, c & ~0x20)) {
+			set_add(set, c);
+			set_add(set, c & ~0x20);
+		}
+	}
+}
+
+
+static bool
+is_space(unsigned char c)
+{
+	return c == ' ' || c == '\t' || c == '\n' || c == '\r' || c == '\f' || c == '\v';
+}
+
+
+/* ------------------------------------------------------------------------- */
+/* parsing                                                                   */
+
+typedef struct re_parser {
+	const char * p;
+	const char * end;
+	int flags;
+	int depth;
+	const char * error;
+} re_parser_t;
+
+
+static re_node_t *
+node_new(re_type_t type, re_node_t * left, re_node_t * right)
+{
+	re_node_t * node = calloc(1, sizeof(re_node_t));
+
+	if (!node) {
+		perror("Error");
+		re_free(left);
+		re_free(right);
+		return NULL;
+	}
+
+	node->type = type;
+	node->left = left;
+	node->right = right;
+
+	return node;
+}
+
+
+static re_node_t *
+node_set(const uint64_t * set)
+{
+	re_node_t * node = node_new(RE_SET, NULL, NULL);
+
+	if (node)
+		memcpy(node->set, set, sizeof(node->set));
+
+	return node;
+}
+
+
+static re_node_t *
+node_byte(unsigned char c, int flags)
+{
+	uint64_t set[4] = { 0 };
+
+	set_add(set, c);
+	if (flags & DFA_IGNORE_CASE)
+		set_fold(set);
+
+	return node_set(set);
+}
+
+
+/*
+ * Adds the set of the escape at p->p, the backslash already consumed.
+ * Returns false if the escape is unknown.
+ */
+static bool
+parse_escape(re_parser_t * p, uint64_t * set)
+{
+	uint64_t class[4] = { 0 };
+	unsigned char c;
+
+	if (p->p == p->end) {
+		p->error = "trailing backslash";
+		return false;
+	}
+
+	c = *p->p++;
+
+	switch (c) {
+	case 'd': case 'D':
+		set_range(class, '0', '9');
+		break;
+	case 'w': case 'W':
+		set_range(class, '0', '9');
+		set_range(class, 'a', 'z');
+		set_range(class, 'A', 'Z');
+		set_add(class, '_');
+		break;
+	case 's': case 'S':
+		for (int b = 0; b < 256; b++)
+			if (is_space(b))
+				set_add(class, b);
+		break;
+	case 'n':
+		set_add(set, '\n');
+		return true;
+	case 't':
+		set_add(set, '\t');
+		return true;
+	case 'r':
+		set_add(set, '\r');
+		return true;
+	default:
+		if ((c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z') || (c >= '0' && c <= '9')) {
+			p->error = "unknown escape";
+			return false;
+		}
+		set_add(set, c);
+		return true;
+	}
+
+	if (c == 'D' || c == 'W' || c == 'S')
+		set_invert(class);
+
+	for (int i = 0; i < 4; i++)
+		set[i] |= class[i];
+
+	return true;
+}
+
+
+static re_node_t *
+parse_class(re_parser_t * p)
+{
+	uint64_t set[4] = { 0 };
+	bool negate = false, first = true;
+	unsigned char c, to;
+
+	if (p->p < p->end && *p->p == '^') {
+		negate = true;
+		p->p++;
+	}
+
+	while (p->p < p->end && (*p->p != ']' || first)) {
+		first = false;
+		c = *p->p++;
+
+		if (c == '\\') {
+			if (!parse_escape(p, set))
+				return NULL;
+			continue;
+		}
+
+		if (p->p + 1 < p->end && *p->p == '-' && p->p[1] != ']') {
+			to = p->p[1];
+			p->p += 2;
+
+			if (to < c) {
+				p->error = "invalid range";
+				return NULL;
+			}
+
+			set_range(set, c, to);
+		} else {
+			set_add(set, c);
+		}
+	}
+
+	if (p->p == p->end) {
+		p->error = "unterminated class";
+		return NULL;
+	}
+	p->p++;
+
+	// fold before negating, or [^a] would take 'a' back through 'A'
+	if (p->flags & DFA_IGNORE_CASE)
+		set_fold(set);
+	if (negate)
+		set_invert(set);
+
+	return node_set(set);
+}
+
+
+static re_node_t *
+parse_alt(re_parser_t * p);
+
+
+static re_node_t *
+parse_atom(re_parser_t * p)
+{
+	uint64_t set[4] = { 0 };
+	re_node_t * node;
+	unsigned char c = *p->p++;
+
+	switch (c) {
+	case '(':
+		if (++p->depth > RE_MAX_DEPTH) {
+			p->error = "too deeply nested";
+			return NULL;
+		}
+
+		if (!(node = parse_alt(p)))
+			return NULL;
+
+		if (p->p == p->end || *p->p != ')') {
+			p->error = "missing )";
+			re_free(node);
+			return NULL;
+		}
+		p->p++;
+		p->depth--;
+
+		return node;
+	case '[':
+		return parse_class(p);
+	case '.':
+		set_invert(set);
+		return node_set(set);
+	case '\\':
+		if (!parse_escape(p, set))
+			return NULL;
+		if (p->flags & DFA_IGNORE_CASE)
+			set_fold(set);
+		return node_set(set);
+	case '^': case '$':
+		p->error = "anchors are not supported";
+		return NULL;
+	case '*': case '+': case '?': case '{':
+		p->error = "nothing to repeat";
+		return NULL;
+	default:
+		return node_byte(c, p->flags);
+	}
+}
+
+
+static bool
+parse_count(re_parser_t * p, int * value)
+{
+	const char * start = p->p;
+
+	*value = 0;
+	for (; p->p < p->end && *p->p >= '0' && *p->p <= '9'; p->p++)
+		if (*value <= RE_MAX_REPEAT)
+			*value = *value * 10 + (*p->p - '0');
+
+	return p->p != start;
+}
+
+
+/* parses the quantifier at p->p, the opening brace already consumed */
+static bool
+parse_bounds(re_parser_t * p, int * min, int * max)
+{
+	if (!parse_count(p, min))
+		goto error;
+
+	*max = *min;
+	if (p->p < p->end && *p->p == ',') {
+		p->p++;
+		if (!parse_count(p, max))
+			*max = -1;
+	}
+
+	if (p->p == p->end || *p->p != '}')
+		goto error;
+	p->p++;
+
+	if (*min > RE_MAX_REPEAT || *max > RE_MAX_REPEAT) {
+		p->error = "repetition count too large";
+		return false;
+	}
+
+	if (*max != -1 && *max < *min)
+		goto error;
+
+	return true;
+
+error:
+	p->error = "malformed repetition";
+	return false;
+}
+
+
+static re_node_t *
+parse_repeat(re_parser_t * p)
+{
+	re_node_t * node = parse_atom(p);
+	int min, max;
+
+	while (node && p->p < p->end) {
+		switch (*p->p++) {
+		case '*':
+			min = 0;
+			max = -1;
+			break;
+		case '+':
+			min = 1;
+			max = -1;
+			break;
+		case '?':
+			min = 0;
+			max = 1;
+			break;
+		case '{':
+			if (!parse_bounds(p, &min, &max)) {
+				re_free(node);
+				return NULL;
+			}
+			break;
+		default:
+			p->p--;
+			return node;
+		}
+
+		if ((node = node_new(RE_REPEAT, node, NULL))) {
+			node->min = min;
+			node->max = max;
+		}
+	}
+
+	return node;
+}
+
+
+static re_node_t *
+parse_cat(re_parser_t * p)
+{
+	re_node_t * node = NULL, * next;
+
+	while (p->p < p->end && *p->p != '|' && *p->p != ')') {
+		if (!(next = parse_repeat(p))) {
+			re_free(node);
+			return NULL;
+		}
+
+		node = node ? node_new(RE_CAT, node, next) : next;
+		if (!node)
+			return NULL;
+	}
+
+	return node ? node : node_new(RE_EMPTY, NULL, NULL);
+}
+
+
+static re_node_t *
+parse_alt(re_parser_t * p)
+{
+	re_node_t * node = parse_cat(p), * next;
+
+	while (node && p->p < p->end && *p->p == '|') {
+		p->p++;
+
+		if (!(next = parse_cat(p))) {
+			re_free(node);
+			return NULL;
+		}
+
+		node = node_new(RE_ALT, node, next);
+	}
+
+	return node;
+}
+
+
+re_node_t *
+re_parse(const char * pattern, size_t length, int flags, const char * * error)
+{
+	re_parser_t p = { pattern, pattern + length, flags, 0, NULL };
+	re_node_t * node = parse_alt(&p);
+
+	if (node && p.p != p.end) {
+		p.error = "unbalanced )";
+		re_free(node);
+		node = NULL;
+	}
+
+	if (!node)
+		*error = p.error ? p.error : "out of memory";
+
+	return node;
+}
+
+
+re_node_t *
+re_literal(const char * text, size_t length, int flags)
+{
+	uint64_t space[4] = { 0 };
+	re_node_t * node = NULL, * next;
+	size_t i = 0;
+
+	for (int b = 0; b < 256; b++)
+		if (is_space(b))
+			set_add(space, b);
+
+	while (i < length && is_space(text[i]))
+		i++;
+	while (length > i && is_space(text[length - 1]))
+		length--;
+
+	while (i < length) {
+		if (is_space(text[i])) {
+			// words of a phrase may be separated by any run of whitespace
+			while (is_space(text[i]))
+				i++;
+
+			if ((next = node_new(RE_REPEAT, node_set(space), NULL))) {
+				next->min = 1;
+				next->max = -1;
+			}
+		} else {
+			next = node_byte(text[i++], flags);
+		}
+
+		if (!next) {
+			re_free(node);
+			return NULL;
+		}
+
+		node = node ? node_new(RE_CAT, node, next) : next;
+		if (!node)
+			return NULL;
+	}
+
+	return node ? node : node_new(RE_EMPTY, NULL, NULL);
+}
+
+
+void
+re_free(re_node_t * node)
+{
+	if (!node)
+		return;
+
+	re_free(node->left);
+	re_free(node->right);
+	free(node);
+}
+
+
+/* ------------------------------------------------------------------------- */
+/* Thompson NFA                                                              */
+
+typedef enum nfa_type {
+	NFA_SET,	/* consumes a byte of set, then goes to out */
+	NFA_SPLIT,	/* goes to both out and out1 without consuming */
+	NFA_MATCH	/* atom matched */
+} nfa_type_t;
+
+
+typedef struct nfa_state {
+	nfa_type_t type;
+	int atom;
+	int out, out1;
+	const uint64_t * set;	/* points into the re_node_t it came from */
+} nfa_state_t;
+
+
+typedef struct nfa {
+	nfa_state_t * states;
+	int count;
+	int capacity;
+	int * starts;		/* first state of each atom */
+	int * ends;		/* states of atom i are [ends[i - 1], ends[i]) */
+	uint64_t * important;	/* SET and MATCH states, the ones a DFA state is made of */
+	int words;
+} nfa_t;
+
+
+static int
+nfa_add(nfa_t * nfa, nfa_type_t type, int out, int out1)
+{
+	nfa_state_t * states;
+
+	if (nfa->count == NFA_MAX_STATES)
+		return -1;
+
+	if (nfa->count == nfa->capacity) {
+		nfa->capacity = nfa->capacity ? nfa->capacity * 2 : 64;
+		if (!(states = realloc(nfa->states, nfa->capacity * sizeof(nfa_state_t)))) {
+			perror("Error");
+			return -1;
+		}
+		nfa->states = states;
+	}
+
+	nfa->states[nfa->count] = (nfa_state_t){ type, -1, out, out1, NULL };
+
+	return nfa->count++;
+}
+
+
+/* compiles node so that it continues to next, returns its first state */
+static int
+nfa_compile(nfa_t * nfa, const re_node_t * node, int next)
+{
+	int state, loop, body;
+
+	if (next < 0)
+		return -1;
+
+	switch (node->type) {
+	case RE_EMPTY:
+		return next;
+	case RE_SET:
+		if ((state = nfa_add(nfa, NFA_SET, next, -1)) >= 0)
+			nfa->states[state].set = node->set;
+		return state;
+	case RE_CAT:
+		return nfa_compile(nfa, node->left, nfa_compile(nfa, node->right, next));
+	case RE_ALT:
+		if ((state = nfa_compile(nfa, node->left, next)) < 0 ||
+				(body = nfa_compile(nfa, node->right, next)) < 0)
+			return -1;
+		return nfa_add(nfa, NFA_SPLIT, state, body);
+	case RE_REPEAT:
+		state = next;
+
+		if (node->max == -1) {
+			if ((loop = nfa_add(nfa, NFA_SPLIT, -1, next)) < 0 ||
+					(body = nfa_compile(nfa, node->left, loop)) < 0)
+				return -1;
+			nfa->states[loop].out = body;
+			state = loop;
+		} else {
+			for (int i = node->min; i < node->max; i++) {
+				if ((body = nfa_compile(nfa, node->left, state)) < 0 ||
+						(state = nfa_add(nfa, NFA_SPLIT, body, next)) < 0)
+					return -1;
+			}
+		}
+
+		for (int i = 0; i < node->min; i++)
+			state = nfa_compile(nfa, node->left, state);
+
+		return state;
+	}
+
+	return -1;
+}
+
+
+static void
+nfa_free(nfa_t * nfa)
+{
+	free(nfa->states);
+	free(nfa->starts);
+	free(nfa->ends);
+	free(nfa->important);
+}
+
+
+static bool
+nfa_build(nfa_t * nfa, re_node_t * * atoms, int count)
+{
+	int match;
+
+	memset(nfa, 0, sizeof(nfa_t));
+
+	nfa->starts = malloc(count * sizeof(int));
+	nfa->ends = malloc(count * sizeof(int));
+	if (!nfa->starts || !nfa->ends) {
+		perror("Error");
+		return false;
+	}
+
+	for (int i = 0; i < count; i++) {
+		if ((match = nfa_add(nfa, NFA_MATCH, -1, -1)) < 0)
+			return false;
+		nfa->states[match].atom = i;
+
+		if ((nfa->starts[i] = nfa_compile(nfa, atoms[i], match)) < 0)
+			return false;
+		nfa->ends[i] = nfa->count;
+	}
+
+	nfa->words = (nfa->count + 63) / 64;
+	if (!(nfa->important = calloc(nfa->words, sizeof(uint64_t)))) {
+		perror("Error");
+		return false;
+	}
+
+	for (int s = 0; s < nfa->count; s++)
+		if (nfa->states[s].type != NFA_SPLIT)
+			nfa->important[s / 64] |= (uint64_t)1 << (s % 64);
+
+	return true;
+}
+
+
+/* adds every state reachable from state without consuming a byte */
+static void
+nfa_closure(const nfa_t * nfa, int state, uint64_t * set, int * stack)
+{
+	int top = 0;
+
+	stack[top++] = state;
+
+	while (top) {
+		state = stack[--top];
+
+		if (set[state / 64] & ((uint64_t)1 << (state % 64)))
+			continue;
+		set[state / 64] |= (uint64_t)1 << (state % 64);
+
+		if (nfa->states[state].type == NFA_SPLIT) {
+			stack[top++] = nfa->states[state].out1;
+			stack[top++] = nfa->states[state].out;
+		}
+	}
+}
+
+
+/* ------------------------------------------------------------------------- */
+/* subset construction                                                       */
+
+typedef struct builder {
+	const nfa_t * nfa;
+	dfa_t * dfa;
+	uint64_t * sets;	/* NFA states of each DFA state */
+	uint32_t * slots;	/* open addressing index of sets, id + 1 */
+	uint32_t capacity;
+	uint64_t * start;
+	int * stack;
+	unsigned char rep[256];	/* a byte of each class */
+} builder_t;
+
+
+#define	SLOTS	(2 * DFA_MAX_STATES)
+
+
+static uint64_t
+hash_set(const uint64_t * set, int words)
+{
+	uint64_t h = 0xcbf29ce484222325;
+
+	for (int i = 0; i < words; i++)
+		h = (h ^ set[i]) * 0x100000001b3;
+
+	return h ^ (h >> 29);
+}
+
+
+/* byte classes: bytes that every SET state of the group treats alike */
+static void
+assign_classes(builder_t * b, uint64_t atoms)
+{
+	const nfa_t * nfa = b->nfa;
+	dfa_t * dfa = b->dfa;
+	int remap[512], first = 0, classes;
+
+	memset(dfa->class_of, 0, sizeof(dfa->class_of));
+	dfa->classes = 1;
+
+	for (int a = 0; a < DFA_MAX_ATOMS && (atoms >> a); first = nfa->ends[a], a++) {
+		if (!(atoms & ((uint64_t)1 << a)))
+			continue;
+
+		for (int s = first; s < nfa->ends[a]; s++) {
+			if (nfa->states[s].type != NFA_SET)
+				continue;
+
+			memset(remap, -1, sizeof(remap));
+			classes = 0;
+
+			for (int c = 0; c < 256; c++) {
+				int key = dfa->class_of[c] * 2 + set_has(nfa->states[s].set, c);
+
+				if (remap[key] < 0)
+					remap[key] = classes++;
+				dfa->class_of[c] = remap[key];
+			}
+
+			dfa->classes = classes;
+		}
+	}
+
+	for (int c = 255; c >= 0; c--)
+		b->rep[dfa->class_of[c]] = c;
+}
+
+
+/* returns the id of the DFA state made of set, adding it if it is new */
+static int64_t
+intern(builder_t * b, const uint64_t * set)
+{
+	dfa_t * dfa = b->dfa;
+	int words = b->nfa->words;
+	uint32_t i = hash_set(set, words) & (SLOTS - 1), id;
+	void * grown;
+
+	for (; b->slots[i]; i = (i + 1) & (SLOTS - 1)) {
+		id = b->slots[i] - 1;
+		if (!memcmp(&b->sets[(size_t)id * words], set, words * sizeof(uint64_t)))
+			return id;
+	}
+
+	if (dfa->num_states == DFA_MAX_STATES)
+		return -1;
+
+	if (dfa->num_states == b->capacity) {
+		b->capacity *= 2;
+		if (!(grown = realloc(b->sets, (size_t)b->capacity * words * sizeof(uint64_t))))
+			return -1;
+		b->sets = grown;
+		if (!(grown = realloc(dfa->delta, (size_t)b->capacity * dfa->classes * sizeof(uint32_t))))
+			return -1;
+		dfa->delta = grown;
+		if (!(grown = realloc(dfa->accepts, (size_t)b->capacity * sizeof(uint64_t))))
+			return -1;
+		dfa->accepts = grown;
+	}
+
+	id = dfa->num_states++;
+	memcpy(&b->sets[(size_t)id * words], set, words * sizeof(uint64_t));
+	b->slots[i] = id + 1;
+
+	dfa->accepts[id] = 0;
+	for (int w = 0; w < words; w++) {
+		for (uint64_t m = set[w]; m; m &= m - 1) {
+			int s = w * 64 + __builtin_ctzll(m);
+			if (b->nfa->states[s].type == NFA_MATCH)
+				dfa->accepts[id] |= (uint64_t)1 << b->nfa->states[s].atom;
+		}
+	}
+
+	return id;
+}
+
+
+static void
+find_skip(dfa_t * dfa)
+{
+	dfa->skip_count = 0;
+
+	for (int c = 0; c < 256; c++) {
+		if (dfa->delta[DFA_START * dfa->classes + dfa->class_of[c]] == DFA_START)
+			continue;
+
+		if (dfa->skip_count == (int)sizeof(dfa->skip)) {
+			dfa->skip_count = 0;
+			return;
+		}
+		dfa->skip[dfa->skip_count++] = c;
+	}
+}
+
+
+/*
+ * Builds the automaton of the atoms in the mask. Every state also holds the
+ * start states of the atoms, which makes the search unanchored. Returns NULL
+ * if it needs more than DFA_MAX_STATES states.
+ */
+static dfa_t *
+dfa_build(const nfa_t * nfa, uint64_t atoms)
+{
+	builder_t b = { .nfa = nfa, .capacity = 64 };
+	int words = nfa->words;
+	uint64_t * next = NULL;
+	int64_t id;
+	dfa_t * dfa = calloc(1, sizeof(dfa_t));
+
+	b.dfa = dfa;
+	b.slots = calloc(SLOTS, sizeof(uint32_t));
+	b.start = calloc(words, sizeof(uint64_t));
+	b.stack = malloc(2 * nfa->count * sizeof(int));
+	b.sets = malloc((size_t)b.capacity * words * sizeof(uint64_t));
+	next = malloc(words * sizeof(uint64_t));
+	if (!dfa || !b.slots || !b.start || !b.stack || !b.sets || !next)
+		goto error;
+
+	dfa->atoms = atoms;
+	assign_classes(&b, atoms);
+
+	dfa->delta = malloc((size_t)b.capacity * dfa->classes * sizeof(uint32_t));
+	dfa->accepts = malloc(b.capacity * sizeof(uint64_t));
+	if (!dfa->delta || !dfa->accepts)
+		goto error;
+
+	for (int a = 0; a < DFA_MAX_ATOMS && (atoms >> a); a++)
+		if (atoms & ((uint64_t)1 << a))
+			nfa_closure(nfa, nfa->starts[a], b.start, b.stack);
+	for (int w = 0; w < words; w++)
+		b.start[w] &= nfa->important[w];
+
+	if (intern(&b, b.start) != DFA_START)
+		goto error;
+
+	for (uint32_t state = 0; state < dfa->num_states; state++) {
+		for (int c = 0; c < dfa->classes; c++) {
+			memset(next, 0, words * sizeof(uint64_t));
+
+			for (int w = 0; w < words; w++) {
+				for (uint64_t m = b.sets[(size_t)state * words + w]; m; m &= m - 1) {
+					const nfa_state_t * s = &nfa->states[w * 64 + __builtin_ctzll(m)];
+					if (s->type == NFA_SET && set_has(s->set, b.rep[c]))
+						nfa_closure(nfa, s->out, next, b.stack);
+				}
+			}
+
+			for (int w = 0; w < words; w++)
+				next[w] = (next[w] & nfa->important[w]) | b.start[w];
+
+			if ((id = intern(&b, next)) < 0)
+				goto error;
+
+			dfa->delta[(size_t)state * dfa->classes + c] = id;
+		}
+	}
+
+	find_skip(dfa);
+
+	free(b.slots);
+	free(b.start);
+	free(b.stack);
+	free(b.sets);
+	free(next);
+
+	return dfa;
+
+error:
+	free(b.slots);
+	free(b.start);
+	free(b.stack);
+	free(b.sets);
+	free(next);
+	if (dfa)
+		dfa_destroy(dfa);
+
+	return NULL;
+}
+
+
+static bool
+compile_group(const nfa_t * nfa, int first, int last, dfa_t * * * dfas, int * count)
+{
+	uint64_t atoms = 0;
+	dfa_t * dfa, * * grown;
+	int middle = first + (last - first) / 2;
+
+	for (int a = first; a < last; a++)
+		atoms |= (uint64_t)1 << a;
+
+	if (!(dfa = dfa_build(nfa, atoms))) {
+		// too many states for one automaton, try with half the atoms each
+		if (last - first == 1)
+			return false;
+
+		return compile_group(nfa, first, middle, dfas, count) &&
+			compile_group(nfa, middle, last, dfas, count);
+	}
+
+	if (!(grown = realloc(*dfas, (*count + 1) * sizeof(dfa_t *)))) {
+		perror("Error");
+		dfa_destroy(dfa);
+		return false;
+	}
+
+	*dfas = grown;
+	(*dfas)[(*count)++] = dfa;
+
+	return true;
+}
+
+
+int
+dfa_compile(re_node_t * * atoms, int count, dfa_t * * * dfas)
+{
+	nfa_t nfa;
+	int compiled = 0;
+
+	*dfas = NULL;
+
+	if (count < 1 || count > DFA_MAX_ATOMS)
+		return -1;
+
+	if (!nfa_build(&nfa, atoms, count) || !compile_group(&nfa, 0, count, dfas, &compiled)) {
+		for (int i = 0; i < compiled; i++)
+			dfa_destroy((*dfas)[i]);
+		free(*dfas);
+		*dfas = NULL;
+		nfa_free(&nfa);
+		return -1;
+	}
+
+	nfa_free(&nfa);
+
+	return compiled;
+}
+
+
+/* ------------------------------------------------------------------------- */
+/* matching                                                                  */
+
+/* the start state loops on every byte but a few, look for those directly */
+static inline size_t
+skip_start(const dfa_t * dfa, const unsigned char * text, size_t i, size_t length)
+{
+	const unsigned char * match;
+
+	if (dfa->skip_count == 1) {
+		match = memchr(&text[i], dfa->skip[0], length - i);
+		return match ? (size_t)(match - text) : length;
+	}
+
+	for (; i < length; i++)
+		if (text[i] == dfa->skip[0] || text[i] == dfa->skip[1] ||
+				(dfa->skip_count == 3 && text[i] == dfa->skip[2]))
+			return i;
+
+	return length;
+}
+
+
+uint32_t
+dfa_scan(const dfa_t * dfa, uint32_t state, const char * text, size_t length, uint64_t * found)
+{
+	const unsigned char * t = (const unsigned char *)text;
+	size_t i = 0;
+
+	// atoms that match the empty string are found in any text
+	*found |= dfa->accepts[state];
+
+	while (i < length) {
+		if (state == DFA_START && dfa->skip_count) {
+			if ((i = skip_start(dfa, t, i, length)) == length)
+				break;
+		}
+
+		state = dfa->delta[(size_t)state * dfa->classes + dfa->class_of[t[i++]]];
+
+		if (dfa->accepts[state]) {
+			*found |= dfa->accepts[state];
+			if ((*found & dfa->atoms) == dfa->atoms)
+				break;
+		}
+	}
+
+	return state;
+}
+
+
+void
+dfa_destroy(dfa_t * dfa)
+{
+	free(dfa->delta);
+	free(dfa->accepts);
+	free(dfa);
+}
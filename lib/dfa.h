@@ -0,0 +1,98 @@
+#ifndef DFA_H
+#define DFA_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+
+/* ASCII letters match regardless of case */
+#define	DFA_IGNORE_CASE	(1 << 0)
+
+/* atoms are reported as bits of a uint64_t */
+#define	DFA_MAX_ATOMS	64
+
+/* a group of atoms whose automaton grows past this is split in two */
+#define	DFA_MAX_STATES	4096
+
+#define	DFA_START	0
+
+
+typedef enum re_type {
+	RE_EMPTY,
+	RE_SET,		/* any byte of set */
+	RE_CAT,
+	RE_ALT,
+	RE_REPEAT	/* left between min and max times, max -1 for no bound */
+} re_type_t;
+
+
+/* parsed form of a regular expression, a word or a phrase */
+typedef struct re_node {
+	re_type_t type;
+	uint64_t set[4];
+	int min, max;
+	struct re_node * left, * right;
+} re_node_t;
+
+
+/*
+ * Every atom of a group compiled into one unanchored deterministic automaton,
+ * so each byte of text costs one table lookup whatever the number of atoms.
+ * Read-only once created, so it can be shared by every thread.
+ */
+typedef struct dfa {
+	int classes;
+	uint8_t class_of[256];
+	uint32_t num_states;
+	uint32_t * delta;	/* num_states x classes transitions */
+	uint64_t * accepts;	/* atoms that end a match when entering a state */
+	uint64_t atoms;		/* atoms of the group */
+	int skip_count;		/* bytes that leave the start state, 0 if too many */
+	unsigned char skip[3];
+} dfa_t;
+
+
+/*
+ * Parses a restricted regular expression: literals, '.', classes such as
+ * [a-z] and [^0-9], the escapes \d \w \s and their negations, groups,
+ * alternation and the * + ? {m} {m,} {m,n} quantifiers. There are no
+ * anchors or backreferences, so every expression has a DFA. Returns NULL
+ * and sets error if the expression is malformed.
+ */
+re_node_t *
+re_parse(const char * pattern, size_t length, int flags, const char * * error);
+
+
+/* a literal word, or a phrase whose words are separated by any whitespace */
+re_node_t *
+re_literal(const char * text, size_t length, int flags);
+
+
+void
+re_free(re_node_t * node);
+
+
+/*
+ * Compiles atoms into as few automata as fit DFA_MAX_STATES each, atom i
+ * being reported as bit i. Returns the number of automata stored in dfas,
+ * or -1 if an atom alone is too large.
+ */
+int
+dfa_compile(re_node_t * * atoms, int count, dfa_t * * * dfas);
+
+
+/*
+ * Runs text through the automaton from state, or'ing the atoms that match
+ * into found. Returns the state to resume from with the next part of the
+ * text; stops early once every atom of the automaton was found.
+ */
+uint32_t
+dfa_scan(const dfa_t * dfa, uint32_t state, const char * text, size_t length, uint64_t * found);
+
+
+void
+dfa_destroy(dfa_t * dfa);
+
+
+#endif /* DFA_H */
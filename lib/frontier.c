@@ -0,0 +1,754 @@
+#include <limits.h>
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "frontier.h"
+#include "hash.h"
+
+
+#define LOCK(lock)		pthread_mutex_lock(&lock);
+#define UNLOCK(lock)	pthread_mutex_unlock(&lock);
+
+#define	INITIAL_BUCKETS	64
+#define	INITIAL_URLS	8
+#define	LATENCY_WEIGHT	0.25	/* of the newest response time in the moving average */
+#define	LATENCY_LIMIT	2.0		/* times the baseline, before the host is slowed down */
+#define	RATE_STEPS		8		/* responses that bring a host back to the configured rate */
+#define	SEGMENT_URLS	(1 << 20)	/* urls written to a segment before the next one is started */
+#define	SPILL_BATCH		4096	/* urls read back at once */
+#define	SPILL_BUFFER	(1 << 20)	/* stdio buffer of a segment, so it is written and read in large blocks */
+#define	SPILL_ID		UINT32_MAX	/* the length of a record that holds an id and its host instead of a url */
+
+
+/* a url read back, with its host if it was spilled by id */
+typedef struct spilled_url {
+	frontier_url_t entry;
+	host_t * host;
+} spilled_url_t;
+
+
+static double
+now(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+
+	return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+
+static bool
+earlier(host_t * a, host_t * b)
+{
+	return a->ready < b->ready;
+}
+
+
+/* the host with the best url, of two that are as good the one that waited longer */
+static bool
+better(host_t * a, host_t * b)
+{
+	return a->top > b->top || (a->top == b->top && a->ready < b->ready);
+}
+
+
+frontier_t *
+frontier_create(size_t max_memory, const char * spill_dir, int connections, double rate)
+{
+	frontier_t * frontier = calloc(1, sizeof(frontier_t));
+
+	if (!frontier) {
+		perror("Error");
+		return NULL;
+	}
+
+	frontier->buckets = calloc(INITIAL_BUCKETS, sizeof(host_t *));
+	if (!frontier->buckets || (spill_dir && !(frontier->spill_dir = strdup(spill_dir)))) {
+		perror("Error");
+		free(frontier->buckets);
+		free(frontier);
+		return NULL;
+	}
+
+	pthread_mutex_init(&frontier->lock, NULL);
+	frontier->num_buckets = INITIAL_BUCKETS;
+	frontier->waiting.before = earlier;
+	frontier->due.before = better;
+	frontier->max_memory = max_memory;
+	frontier->connections = connections;
+	frontier->rate = rate;
+
+	return frontier;
+}
+
+
+static inline void
+heap_set(host_heap_t * heap, size_t i, host_t * host)
+{
+	heap->hosts[i] = host;
+	host->heap_index = i;
+}
+
+
+static void
+heap_up(host_heap_t * heap, size_t i)
+{
+	host_t * host = heap->hosts[i];
+
+	while (i > 0 && heap->before(host, heap->hosts[(i - 1) / 2])) {
+		heap_set(heap, i, heap->hosts[(i - 1) / 2]);
+		i = (i - 1) / 2;
+	}
+
+	heap_set(heap, i, host);
+}
+
+
+static void
+heap_down(host_heap_t * heap, size_t i)
+{
+	host_t * host = heap->hosts[i];
+	size_t child;
+
+	while ((child = 2 * i + 1) < heap->size) {
+		if (child + 1 < heap->size && heap->before(heap->hosts[child + 1], heap->hosts[child]))
+			child++;
+		if (!heap->before(heap->hosts[child], host))
+			break;
+
+		heap_set(heap, i, heap->hosts[child]);
+		i = child;
+	}
+
+	heap_set(heap, i, host);
+}
+
+
+/* both heaps have room for every host, so this cannot fail */
+static void
+heap_insert(host_heap_t * heap, host_t * host)
+{
+	host->heap = heap;
+	heap_set(heap, heap->size++, host);
+	heap_up(heap, host->heap_index);
+}
+
+
+static void
+heap_remove(host_t * host)
+{
+	host_heap_t * heap = host->heap;
+	host_t * last = heap->hosts[--heap->size];
+
+	host->heap = NULL;
+	if (last == host)
+		return;
+
+	heap_set(heap, host->heap_index, last);
+	heap_up(heap, last->heap_index);
+	heap_down(heap, last->heap_index);
+}
+
+
+/*
+ * Puts the host where it belongs: in neither heap without urls or a free
+ * connection, else in due or waiting depending on whether its time came.
+ */
+static void
+schedule(frontier_t * frontier, host_t * host, double time)
+{
+	host_heap_t * heap = NULL;
+
+	if (host->count > 0 && host->active < frontier->connections)
+		heap = host->ready <= time ? &frontier->due : &frontier->waiting;
+
+	if (host->heap != heap) {
+		if (host->heap)
+			heap_remove(host);
+		if (heap)
+			heap_insert(heap, host);
+	} else if (heap) {
+		heap_up(heap, host->heap_index);
+		heap_down(heap, host->heap_index);
+	}
+}
+
+
+/* when the host has its next token, or had it */
+static inline void
+set_ready(host_t * host)
+{
+	host->ready = host->tokens >= 1 ? host->refilled : host->refilled + (1 - host->tokens) / host->rate;
+}
+
+
+/* tokens earned since the last refill, the idle time beyond a full bucket is lost */
+static void
+refill(frontier_t * frontier, host_t * host, double time)
+{
+	host->tokens += (time - host->refilled) * host->rate;
+	if (host->tokens > frontier->connections)
+		host->tokens = frontier->connections;
+	host->refilled = time;
+}
+
+
+static bool
+grow_buckets(frontier_t * frontier)
+{
+	size_t size = frontier->num_buckets * 2;
+	host_t * * buckets = calloc(size, sizeof(host_t *)), * host, * next;
+
+	if (!buckets) {
+		perror("Error");
+		return false;
+	}
+
+	for (size_t i = 0; i < frontier->num_buckets; i++) {
+		for (host = frontier->buckets[i]; host; host = next) {
+			next = host->next;
+			host->next = buckets[host->hash & (size - 1)];
+			buckets[host->hash & (size - 1)] = host;
+		}
+	}
+
+	free(frontier->buckets);
+	frontier->buckets = buckets;
+	frontier->num_buckets = size;
+
+	return true;
+}
+
+
+/* keeps room for every host in both heaps */
+static bool
+grow_heaps(frontier_t * frontier)
+{
+	size_t capacity = frontier->heap_capacity ? 2 * frontier->heap_capacity : INITIAL_BUCKETS;
+	host_t * * waiting, * * due;
+
+	if (!(waiting = realloc(frontier->waiting.hosts, capacity * sizeof(host_t *)))) {
+		perror("Error");
+		return false;
+	}
+	frontier->waiting.hosts = waiting;
+
+	if (!(due = realloc(frontier->due.hosts, capacity * sizeof(host_t *)))) {
+		perror("Error");
+		return false;
+	}
+	frontier->due.hosts = due;
+
+	frontier->heap_capacity = capacity;
+	return true;
+}
+
+
+/* the host of url, created at the configured rate the first time it shows up */
+static host_t *
+get_host(frontier_t * frontier, url_t * url, double time)
+{
+	size_t length = url_origin_length(url);
+	uint64_t hash = hash_bytes(url->str, length, 0);
+	host_t * host, * * bucket;
+
+	bucket = &frontier->buckets[hash & (frontier->num_buckets - 1)];
+	for (host = *bucket; host; host = host->next)
+		if (host->hash == hash && host->origin_length == length && !memcmp(host->origin, url->str, length))
+			return host;
+
+	if (frontier->num_hosts == frontier->heap_capacity && !grow_heaps(frontier))
+		return NULL;
+
+	if (frontier->num_hosts >= frontier->num_buckets && grow_buckets(frontier))
+		bucket = &frontier->buckets[hash & (frontier->num_buckets - 1)];
+
+	if (!(host = calloc(1, sizeof(host_t) + length + 1))) {
+		perror("Error");
+		return NULL;
+	}
+
+	host->hash = hash;
+	host->top = -1;
+	host->tokens = frontier->connections;
+	host->rate = frontier->rate;
+	host->refilled = time;
+	host->ready = time;
+	host->origin_length = length;
+	memcpy(host->origin, url->str, length);
+
+	host->next = *bucket;
+	*bucket = host;
+	frontier->num_hosts++;
+
+	return host;
+}
+
+
+static bool
+ring_push(url_ring_t * ring, frontier_url_t entry)
+{
+	frontier_url_t * urls;
+	uint32_t capacity;
+
+	if (ring->count == ring->capacity) {
+		capacity = ring->capacity ? 2 * ring->capacity : INITIAL_URLS;
+		if (!(urls = realloc(ring->urls, capacity * sizeof(frontier_url_t)))) {
+			perror("Error");
+			return false;
+		}
+
+		// the urls that wrapped around the end move past the old end
+		memcpy(urls + ring->capacity, urls, ring->head * sizeof(frontier_url_t));
+		ring->urls = urls;
+		ring->capacity = capacity;
+	}
+
+	ring->urls[(ring->head + ring->count++) & (ring->capacity - 1)] = entry;
+
+	return true;
+}
+
+
+static frontier_url_t
+ring_pop(url_ring_t * ring)
+{
+	frontier_url_t next = ring->urls[ring->head];
+
+	ring->head = (ring->head + 1) & (ring->capacity - 1);
+	ring->count--;
+
+	return next;
+}
+
+
+static inline int
+score_level(float score)
+{
+	int level = (int)(score * (FRONTIER_LEVELS - 1) + 0.5f);
+
+	return level < 0 ? 0 : level >= FRONTIER_LEVELS ? FRONTIER_LEVELS - 1 : level;
+}
+
+
+/* what a url costs while it is queued in memory, an id only its entry */
+static inline size_t
+url_memory(const frontier_url_t * entry)
+{
+	return entry->url ? sizeof(url_t) + entry->url->length + 1 + sizeof(frontier_url_t) : sizeof(frontier_url_t);
+}
+
+
+static bool
+queue_entry(frontier_t * frontier, host_t * host, frontier_url_t entry, double time)
+{
+	int level = score_level(entry.score);
+
+	if (!ring_push(&host->levels[level], entry))
+		return false;
+
+	host->count++;
+	frontier->size++;
+	frontier->memory += url_memory(&entry);
+
+	// a host's first url, or a better one, changes its place
+	if (level > host->top) {
+		host->top = level;
+		schedule(frontier, host, time);
+	}
+
+	return true;
+}
+
+
+/* queues url, or only its id if id is not NULL */
+static bool
+queue_url(frontier_t * frontier, url_t * url, const uint32_t * id, float score, double time)
+{
+	frontier_url_t entry = { id ? NULL : url, id ? *id : 0, score };
+	host_t * host = get_host(frontier, url, time);
+
+	return host && queue_entry(frontier, host, entry, time);
+}
+
+
+/* a new segment, unlinked right away so it goes away with the frontier however it ends */
+static spill_segment_t *
+add_segment(frontier_t * frontier)
+{
+	spill_segment_t * segment = calloc(1, sizeof(spill_segment_t));
+	char path[PATH_MAX];
+	int fd;
+
+	if (!segment) {
+		perror("Error");
+		return NULL;
+	}
+
+	snprintf(path, sizeof(path), "%s/frontier-XXXXXX", frontier->spill_dir);
+	if ((fd = mkstemp(path)) == -1 || !(segment->file = fdopen(fd, "w+"))) {
+		perror(path);
+		if (fd != -1)
+			close(fd);
+		free(segment);
+		return NULL;
+	}
+	unlink(path);
+	setvbuf(segment->file, NULL, _IOFBF, SPILL_BUFFER);
+
+	if (frontier->spill_tail)
+		frontier->spill_tail->next = segment;
+	else
+		frontier->spill_head = segment;
+	frontier->spill_tail = segment;
+
+	return segment;
+}
+
+
+/*
+ * Appends url to the segment being written and frees it, or only its id if
+ * id is not NULL. An id is written with its host, which lives as long as
+ * the frontier, as the url store its id comes from lives as long as the
+ * crawl. A write that fails midway leaves a torn record after the last
+ * whole one; reads stop at the count of whole ones, and nothing is appended
+ * behind it.
+ */
+static bool
+spill_url(frontier_t * frontier, url_t * url, const uint32_t * id, float score, double time)
+{
+	spill_segment_t * segment = frontier->spill_tail;
+	uint32_t length = id ? SPILL_ID : url->length;
+	host_t * host = NULL;
+
+	if (id && !(host = get_host(frontier, url, time)))
+		return false;
+
+	if (!segment || segment->sealed || segment->torn || segment->count == SEGMENT_URLS)
+		if (!(segment = add_segment(frontier)))
+			return false;
+
+	if (fwrite(&length, sizeof(length), 1, segment->file) != 1 ||
+			fwrite(&score, sizeof(score), 1, segment->file) != 1 ||
+			(id ? fwrite(id, sizeof(*id), 1, segment->file) != 1 || fwrite(&host, sizeof(host), 1, segment->file) != 1 :
+			fwrite(url->str, 1, length, segment->file) != length)) {
+		perror("Error");
+		segment->torn = true;
+		return false;
+	}
+
+	segment->count++;
+	frontier->spilled++;
+	if (!id)
+		url_free(url);
+
+	return true;
+}
+
+
+/*
+ * Reads up to count urls of the segment into batch, without the lock.
+ * Returns how many were read; failed is set if the rest of the segment
+ * cannot be read, and left alone if a url is only short of memory.
+ */
+static size_t
+read_urls(frontier_t * frontier, spill_segment_t * segment, spilled_url_t * batch, size_t count, bool * failed)
+{
+	uint32_t length, id;
+	float score;
+	url_t * url;
+	host_t * host;
+	char * buffer;
+	size_t n;
+
+	for (n = 0; n < count; n++) {
+		if (fread(&length, sizeof(length), 1, segment->file) != 1 ||
+				fread(&score, sizeof(score), 1, segment->file) != 1) {
+			*failed = true;
+			break;
+		}
+
+		if (length == SPILL_ID) {
+			if (fread(&id, sizeof(id), 1, segment->file) != 1 || fread(&host, sizeof(host), 1, segment->file) != 1) {
+				*failed = true;
+				break;
+			}
+			batch[n] = (spilled_url_t){ { NULL, id, score }, host };
+			continue;
+		}
+
+		if (length > frontier->buffer_capacity) {
+			if (!(buffer = realloc(frontier->buffer, length))) {
+				perror("Error");
+				fseek(segment->file, -(long)(sizeof(length) + sizeof(score)), SEEK_CUR);
+				break;
+			}
+			frontier->buffer = buffer;
+			frontier->buffer_capacity = length;
+		}
+
+		if (fread(frontier->buffer, 1, length, segment->file) != length) {
+			*failed = true;
+			break;
+		}
+
+		if (!(url = url_create(frontier->buffer, length))) {
+			fseek(segment->file, -(long)(sizeof(length) + sizeof(score) + length), SEEK_CUR);
+			break;
+		}
+
+		batch[n] = (spilled_url_t){ { url, 0, score }, NULL };
+	}
+
+	return n;
+}
+
+
+/*
+ * Reads back up to SPILL_BATCH urls of the oldest segment, with the lock
+ * held on entry and on return but not while on disk. Urls that are spilled
+ * meanwhile go to a newer segment, since this one is sealed. A segment that
+ * cannot be read is dropped, and its urls are counted as lost.
+ */
+static void
+read_back(frontier_t * frontier)
+{
+	spill_segment_t * segment = frontier->spill_head;
+	size_t count = segment->count - segment->read, read = 0, lost = 0;
+	bool first = !segment->sealed, failed = false;
+	spilled_url_t * batch = NULL;
+	host_t * host;
+	double time;
+
+	if (count > SPILL_BATCH)
+		count = SPILL_BATCH;
+	if (count > 0 && !(batch = malloc(count * sizeof(spilled_url_t)))) {
+		perror("Error");
+		return;
+	}
+
+	frontier->reading = true;
+	segment->sealed = true;
+	UNLOCK(frontier->lock);
+
+	if (first && (fflush(segment->file) || fseek(segment->file, 0, SEEK_SET))) {
+		perror("Error");
+		failed = true;
+	} else if (count > 0) {
+		read = read_urls(frontier, segment, batch, count, &failed);
+	}
+
+	LOCK(frontier->lock);
+
+	time = now();
+	for (size_t i = 0; i < read; i++) {
+		host = batch[i].host ? batch[i].host : get_host(frontier, batch[i].entry.url, time);
+		if (!host || !queue_entry(frontier, host, batch[i].entry, time)) {
+			url_free(batch[i].entry.url);
+			lost++;
+		}
+	}
+	segment->read += read;
+	frontier->spilled -= read;
+
+	if (failed) {
+		fprintf(stderr, "Error: could not read back %zu spilled urls\n", segment->count - segment->read);
+		lost += segment->count - segment->read;
+		frontier->spilled -= segment->count - segment->read;
+		segment->read = segment->count;
+	}
+
+	if (segment->read == segment->count) {
+		fclose(segment->file);
+		frontier->spill_head = segment->next;
+		if (!frontier->spill_head)
+			frontier->spill_tail = NULL;
+		free(segment);
+	}
+
+	if (lost > 0)
+		__atomic_add_fetch(&frontier->lost, lost, __ATOMIC_RELEASE);
+	frontier->reading = false;
+	free(batch);
+}
+
+
+size_t
+frontier_push(frontier_t * frontier, url_t * * urls, const uint32_t * ids, const float * scores, size_t count)
+{
+	double time = now();
+	bool spill;
+	float score;
+	size_t i;
+
+	LOCK(frontier->lock);
+
+	for (i = 0; i < count; i++) {
+		score = scores ? scores[i] : 0;
+
+		// the lowest priority is first in first out, on disk or not
+		spill = frontier->memory >= frontier->max_memory || (frontier->spilled > 0 && score_level(score) == 0);
+
+		if (spill && !frontier->spill_dir)
+			break;
+		if (spill ? !spill_url(frontier, urls[i], ids ? &ids[i] : NULL, score, time) :
+				!queue_url(frontier, urls[i], ids ? &ids[i] : NULL, score, time))
+			break;
+	}
+
+	UNLOCK(frontier->lock);
+
+	return i;
+}
+
+
+size_t
+frontier_pop(frontier_t * frontier, frontier_url_t * next, host_t * * hosts, size_t count, int * wait_ms)
+{
+	double time = now();
+	host_t * best;
+	size_t popped;
+
+	*wait_ms = -1;
+
+	LOCK(frontier->lock);
+
+	if (frontier->spilled > 0 && !frontier->reading && frontier->memory < frontier->max_memory / 2) {
+		read_back(frontier);
+		time = now();
+	}
+
+	// hosts whose time came compete for the best url
+	while (frontier->waiting.size > 0 && frontier->waiting.hosts[0]->ready <= time) {
+		best = frontier->waiting.hosts[0];
+		heap_remove(best);
+		heap_insert(&frontier->due, best);
+	}
+
+	for (popped = 0; popped < count && frontier->due.size > 0; popped++) {
+		best = frontier->due.hosts[0];
+
+		refill(frontier, best, time);
+		best->tokens -= 1;
+		set_ready(best);
+
+		next[popped] = ring_pop(&best->levels[best->top]);
+		while (best->top >= 0 && best->levels[best->top].count == 0)
+			best->top--;
+		best->count--;
+		best->active++;
+		frontier->size--;
+		frontier->memory -= url_memory(&next[popped]);
+
+		// out of tokens or connections, the host leaves due
+		schedule(frontier, best, time);
+		hosts[popped] = best;
+	}
+
+	if (popped < count && frontier->waiting.size > 0)
+		*wait_ms = (int)ceil((frontier->waiting.hosts[0]->ready - time) * 1000);
+
+	UNLOCK(frontier->lock);
+
+	return popped;
+}
+
+
+bool
+frontier_done(frontier_t * frontier, host_t * host, long status, double seconds)
+{
+	double time = now();
+	bool idle, woken;
+
+	LOCK(frontier->lock);
+
+	idle = host->heap == NULL;
+	host->active--;
+	refill(frontier, host, time);
+
+	if (host->latency == 0)
+		host->latency = seconds;
+	else
+		host->latency += (seconds - host->latency) * LATENCY_WEIGHT;
+	if (host->baseline == 0 || host->latency < host->baseline)
+		host->baseline = host->latency;
+
+	if (status == 429 || status == 503) {
+		// the host asked us to back off: wait a whole new interval
+		host->rate = fmax(host->rate / 2, FRONTIER_MIN_RATE);
+		host->tokens = fmin(host->tokens, 0);
+	} else if (host->latency > host->baseline * LATENCY_LIMIT) {
+		// it is struggling to keep up; the baseline moves up so the rate
+		// is only halved again if the response time keeps rising
+		host->rate = fmax(host->rate / 2, FRONTIER_MIN_RATE);
+		host->baseline = host->latency / LATENCY_LIMIT;
+	} else {
+		host->rate = fmin(host->rate + frontier->rate / RATE_STEPS, frontier->rate);
+	}
+	set_ready(host);
+
+	schedule(frontier, host, time);
+	woken = idle && host->heap != NULL;
+
+	UNLOCK(frontier->lock);
+
+	return woken;
+}
+
+
+size_t
+frontier_lost(frontier_t * frontier)
+{
+	if (!__atomic_load_n(&frontier->lost, __ATOMIC_RELAXED))
+		return 0;
+
+	return __atomic_exchange_n(&frontier->lost, 0, __ATOMIC_ACQUIRE);
+}
+
+
+size_t
+frontier_size(frontier_t * frontier)
+{
+	return frontier->size + frontier->spilled;
+}
+
+
+void
+frontier_destroy(frontier_t * frontier)
+{
+	spill_segment_t * segment, * next_segment;
+	host_t * host, * next;
+	url_ring_t * ring;
+
+	for (size_t i = 0; i < frontier->num_buckets; i++) {
+		for (host = frontier->buckets[i]; host; host = next) {
+			next = host->next;
+			for (int level = 0; level < FRONTIER_LEVELS; level++) {
+				ring = &host->levels[level];
+				while (ring->count > 0 && frontier->spill_dir)
+					url_free(ring_pop(ring).url);
+				free(ring->urls);
+			}
+			free(host);
+		}
+	}
+
+	for (segment = frontier->spill_head; segment; segment = next_segment) {
+		next_segment = segment->next;
+		fclose(segment->file);
+		free(segment);
+	}
+
+	pthread_mutex_destroy(&frontier->lock);
+	free(frontier->spill_dir);
+	free(frontier->buffer);
+	free(frontier->buckets);
+	free(frontier->waiting.hosts);
+	free(frontier->due.hosts);
+	free(frontier);
+}
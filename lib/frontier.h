@@ -0,0 +1,192 @@
+#ifndef FRONTIER_H
+#define FRONTIER_H
+
+#include <pthread.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+
+#include "url.h"
+
+
+#define	FRONTIER_CONNECTIONS	2		/* default fetches in flight per host */
+#define	FRONTIER_RATE			4.0		/* default fetches started per second per host */
+#define	FRONTIER_MIN_RATE		0.1		/* a host that keeps pushing back is not slowed down further */
+#define	FRONTIER_LEVELS			8		/* priorities the scores of urls are rounded to */
+#define	FRONTIER_MEMORY			(256 << 20)	/* default bytes of queued urls kept in memory */
+
+
+typedef struct frontier_url {
+	url_t * url;		/* NULL if queued by id */
+	uint32_t id;
+	float score;
+} frontier_url_t;
+
+
+/* urls of one priority, first in first out */
+typedef struct url_ring {
+	frontier_url_t * urls;
+	uint32_t head;
+	uint32_t count;
+	uint32_t capacity;		/* a power of two */
+} url_ring_t;
+
+
+/*
+ * The urls of one origin, highest priority first and in the order they were
+ * found within a priority. The host may start a fetch while it has a token;
+ * tokens come back at the host's rate, up to one per connection, so a host
+ * that was idle may start that many fetches at once.
+ */
+typedef struct host {
+	struct host * next;		/* in the same bucket of the host table */
+	uint64_t hash;
+	url_ring_t levels[FRONTIER_LEVELS];
+	int top;				/* highest level with urls, -1 if none */
+	size_t count;
+	int active;				/* fetches in flight */
+	double tokens;
+	double rate;			/* fetches per second, lowered while the host pushes back */
+	double refilled;		/* when tokens were last brought up to date */
+	double ready;			/* when the host may start its next fetch */
+	double latency;			/* moving average of the response time */
+	double baseline;		/* lowest moving average seen */
+	struct host_heap * heap;	/* the heap it waits in, NULL if none */
+	size_t heap_index;
+	size_t origin_length;
+	char origin[];
+} host_t;
+
+
+/* a file of urls that did not fit in memory, removed once it was read back */
+typedef struct spill_segment {
+	FILE * file;			/* already unlinked */
+	size_t count;			/* urls written */
+	size_t read;			/* urls read back */
+	bool sealed;			/* being read, urls that spill later go to a new segment */
+	bool torn;				/* a write failed midway, nothing more is appended */
+	struct spill_segment * next;
+} spill_segment_t;
+
+
+typedef struct host_heap {
+	host_t * * hosts;
+	size_t size;
+	bool (*before)(host_t *, host_t *);
+} host_heap_t;
+
+
+/*
+ * Urls grouped by host. Hosts that have urls queued and a free connection
+ * wait in one heap, by the time they may start their next fetch, until that
+ * time comes; then they move to another heap that gives out the best url of
+ * all the hosts that may fetch. Urls are ranked by score before age, so
+ * likely hits go first, and no host gets more than its share: the crawl
+ * spreads over hosts instead of queueing on one.
+ *
+ * Every host starts at the configured rate. It is halved each time the host
+ * answers 429 or 503, or its response time doubles from the best it had,
+ * and grows back a little with every response that is neither.
+ *
+ * Urls that do not fit in max_memory are appended to segment files, and so
+ * are urls of the lowest priority while there are urls on disk, so they
+ * keep their order. Once the urls in memory take less than half of it,
+ * pops read them back a batch at a time, oldest segment first. One pop at a
+ * time reads, and it lets go of the lock while it is on disk.
+ *
+ * A single lock protects everything else: operations take it once per page
+ * or per fetch, next to transfers that take milliseconds. Workers share the
+ * frontier rather than keeping deques of their own to steal from: a host's
+ * rate and connections only hold if every worker takes its urls from the
+ * same place.
+ */
+typedef struct frontier {
+	pthread_mutex_t lock;
+	host_t * * buckets;
+	size_t num_buckets;		/* a power of two */
+	size_t num_hosts;
+	host_heap_t waiting;	/* hosts that may fetch later, earliest first */
+	host_heap_t due;		/* hosts that may fetch now, best url first */
+	size_t heap_capacity;	/* of both heaps, at least num_hosts */
+	size_t size;			/* queued urls in memory */
+	size_t memory;			/* bytes they take */
+	size_t max_memory;
+	char * spill_dir;		/* NULL to drop the urls that do not fit */
+	spill_segment_t * spill_head;	/* read from */
+	spill_segment_t * spill_tail;	/* written to */
+	size_t spilled;			/* urls on disk */
+	bool reading;			/* a pop is reading spill_head back */
+	char * buffer;			/* a url read back, the reader's */
+	size_t buffer_capacity;
+	size_t lost;			/* spilled urls that could not be read back, see frontier_lost() */
+	int connections;		/* per host */
+	double rate;			/* per host */
+} frontier_t;
+
+
+/*
+ * Urls spill to unlinked files in spill_dir once they take max_memory
+ * bytes. The frontier frees the urls it spills and creates them again when
+ * it reads them back, and frees the urls still queued on frontier_destroy().
+ * Without a spill_dir the urls stay the caller's, and those that do not
+ * fit are not queued.
+ */
+frontier_t *
+frontier_create(size_t max_memory, const char * spill_dir, int connections, double rate);
+
+
+/*
+ * Queues urls with their scores, from 0 to 1, behind the urls of their
+ * hosts that score as high. scores may be NULL for all 0. Returns how many
+ * were queued, from the first; the rest did not fit and still belong to
+ * the caller.
+ *
+ * If ids is not NULL, only the ids are queued and popped, in 16 bytes a
+ * url: the urls are read for their hosts and stay the caller's. Ids spill
+ * like urls, with their scores and hosts.
+ */
+size_t
+frontier_push(frontier_t * frontier, url_t * * urls, const uint32_t * ids, const float * scores, size_t count);
+
+
+/*
+ * Takes up to count of the best urls of the hosts that may fetch, in one
+ * go under the lock, each with a connection of its host in hosts that
+ * frontier_done() gives back. Returns how many; if no more host may fetch
+ * yet, sets wait_ms to the time until one may, or to -1 if every host is
+ * idle or busy.
+ */
+size_t
+frontier_pop(frontier_t * frontier, frontier_url_t * next, host_t * * hosts, size_t count, int * wait_ms);
+
+
+/*
+ * Gives back the connection of a finished fetch, with its HTTP status and
+ * duration in seconds, and adjusts the host's rate. Returns true if this
+ * let the host fetch again.
+ */
+bool
+frontier_done(frontier_t * frontier, host_t * host, long status, double seconds);
+
+
+/*
+ * Returns how many spilled urls were lost since the last call, because
+ * their segment could not be read back. They are out of the frontier as if
+ * they had been popped and fetched.
+ */
+size_t
+frontier_lost(frontier_t * frontier);
+
+
+/* queued urls, in memory and on disk, not synchronized */
+size_t
+frontier_size(frontier_t * frontier);
+
+
+/* removes the spilled urls, and with a spill_dir frees the queued ones too */
+void
+frontier_destroy(frontier_t * frontier);
+
+
+#endif /* FRONTIER_H */
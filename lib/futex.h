@@ -0,0 +1,108 @@
+#ifndef FUTEX_H
+#define FUTEX_H
+
+#include <errno.h>
+#include <limits.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <time.h>
+#include <unistd.h>
+#include <linux/futex.h>
+#include <sys/syscall.h>
+
+
+/* sleeps while *addr == value, returns false if wait_ms (-1 forever) ran out */
+static inline bool
+futex_wait(uint32_t * addr, uint32_t value, int wait_ms)
+{
+	struct timespec timeout = { wait_ms / 1000, (wait_ms % 1000) * 1000000L };
+
+	if (syscall(SYS_futex, addr, FUTEX_WAIT_PRIVATE, value, wait_ms < 0 ? NULL : &timeout, NULL, 0) == -1)
+		return errno != ETIMEDOUT;
+
+	return true;
+}
+
+
+static inline void
+futex_wake(uint32_t * addr, int count)
+{
+	syscall(SYS_futex, addr, FUTEX_WAKE_PRIVATE, count, NULL, NULL, 0);
+}
+
+
+/*
+ * An eventcount: lets a thread sleep until a condition that is checked
+ * without locks may have changed, without missing a wakeup.
+ *
+ *	key = event_prepare(&event);
+ *	if (condition holds)
+ *		event_cancel(&event);
+ *	else
+ *		event_wait(&event, key, wait_ms);
+ *
+ * and whoever makes the condition true calls event_notify() afterwards.
+ * Notifying is a fence and a load while nobody sleeps.
+ */
+typedef struct event {
+	uint32_t seq;		/* bumped by every notify that found waiters */
+	uint32_t waiters;
+} event_t;
+
+
+static inline uint32_t
+event_prepare(event_t * event)
+{
+	uint32_t key;
+
+	__atomic_add_fetch(&event->waiters, 1, __ATOMIC_SEQ_CST);
+	key = __atomic_load_n(&event->seq, __ATOMIC_SEQ_CST);
+
+	// the condition is checked after this, see event_notify()
+	__atomic_thread_fence(__ATOMIC_SEQ_CST);
+
+	return key;
+}
+
+
+static inline void
+event_cancel(event_t * event)
+{
+	__atomic_sub_fetch(&event->waiters, 1, __ATOMIC_RELAXED);
+}
+
+
+/* returns false if wait_ms ran out, a wakeup may be spurious */
+static inline bool
+event_wait(event_t * event, uint32_t key, int wait_ms)
+{
+	bool woken = futex_wait(&event->seq, key, wait_ms);
+
+	event_cancel(event);
+	return woken;
+}
+
+
+static inline void
+event_notify(event_t * event, int count)
+{
+	// orders the caller's update before the load of waiters, pairing with
+	// the increment in event_prepare(): either the waiter sees the update
+	// when it checks the condition, or we see the waiter
+	__atomic_thread_fence(__ATOMIC_SEQ_CST);
+
+	if (__atomic_load_n(&event->waiters, __ATOMIC_RELAXED)) {
+		__atomic_add_fetch(&event->seq, 1, __ATOMIC_RELEASE);
+		futex_wake(&event->seq, count);
+	}
+}
+
+
+static inline void
+event_notify_all(event_t * event)
+{
+	event_notify(event, INT_MAX);
+}
+
+
+#endif /* FUTEX_H */
@@ -0,0 +1,104 @@
+#ifndef HASH_H
+#define HASH_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+
+
+/*
+ * wyhash: reads the key 8 or 16 bytes at a time and mixes them with 64x64 to
+ * 128-bit multiplications. Every bit of the result depends on every byte of
+ * the key, so its low bits can index a table directly, and long keys that
+ * share a prefix still spread out.
+ */
+
+#define	HASH_SECRET0	0xa0761d6478bd642fULL
+#define	HASH_SECRET1	0xe7037ed1a0b428dbULL
+#define	HASH_SECRET2	0x8ebc6af09c88c6e3ULL
+#define	HASH_SECRET3	0x589965cc75374cc3ULL
+
+
+/* both halves of the 128-bit product, folded */
+static inline uint64_t
+hash_mix(uint64_t a, uint64_t b)
+{
+	__uint128_t r = (__uint128_t)a * b;
+
+	return (uint64_t)r ^ (uint64_t)(r >> 64);
+}
+
+
+static inline uint64_t
+hash_read8(const uint8_t * p)
+{
+	uint64_t v;
+
+	memcpy(&v, p, 8);
+	return v;
+}
+
+
+static inline uint64_t
+hash_read4(const uint8_t * p)
+{
+	uint32_t v;
+
+	memcpy(&v, p, 4);
+	return v;
+}
+
+
+static inline uint64_t
+hash_bytes(const void * key, size_t length, uint64_t seed)
+{
+	const uint8_t * p = key;
+	size_t i = length;
+	uint64_t a, b, see1, see2;
+	__uint128_t r;
+
+	seed ^= hash_mix(seed ^ HASH_SECRET0, HASH_SECRET1);
+
+	if (length <= 16) {
+		if (length >= 4) {
+			// two overlapping 4 byte reads from each end cover 4 to 16 bytes
+			a = (hash_read4(p) << 32) | hash_read4(p + ((length >> 3) << 2));
+			b = (hash_read4(p + length - 4) << 32) | hash_read4(p + length - 4 - ((length >> 3) << 2));
+		} else if (length > 0) {
+			a = ((uint64_t)p[0] << 16) | ((uint64_t)p[length >> 1] << 8) | p[length - 1];
+			b = 0;
+		} else {
+			a = b = 0;
+		}
+	} else {
+		if (i > 48) {
+			// three independent lanes keep the multipliers busy
+			see1 = see2 = seed;
+			do {
+				seed = hash_mix(hash_read8(p) ^ HASH_SECRET1, hash_read8(p + 8) ^ seed);
+				see1 = hash_mix(hash_read8(p + 16) ^ HASH_SECRET2, hash_read8(p + 24) ^ see1);
+				see2 = hash_mix(hash_read8(p + 32) ^ HASH_SECRET3, hash_read8(p + 40) ^ see2);
+				p += 48;
+				i -= 48;
+			} while (i > 48);
+			seed ^= see1 ^ see2;
+		}
+
+		while (i > 16) {
+			seed = hash_mix(hash_read8(p) ^ HASH_SECRET1, hash_read8(p + 8) ^ seed);
+			p += 16;
+			i -= 16;
+		}
+
+		// the last 16 bytes, overlapping the ones already mixed
+		a = hash_read8(p + i - 16);
+		b = hash_read8(p + i - 8);
+	}
+
+	r = (__uint128_t)(a ^ HASH_SECRET1) * (b ^ seed);
+
+	return hash_mix((uint64_t)r ^ HASH_SECRET0 ^ length, (uint64_t)(r >> 64) ^ HASH_SECRET1);
+}
+
+
+#endif /* HASH_H */
@@ -0,0 +1,382 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "query.h"
+
+
+#define	QUERY_MAX_DEPTH	256
+
+
+typedef enum query_type {
+	QUERY_TERM,
+	QUERY_AND,
+	QUERY_OR,
+	QUERY_NOT
+} query_type_t;
+
+
+struct query_node {
+	query_type_t type;
+	int term;
+	query_node_t * left, * right;
+};
+
+
+typedef struct query_parser {
+	const char * p;
+	int flags;
+	int depth;
+	re_node_t * terms[DFA_MAX_ATOMS];
+	int count;
+	const char * error;
+} query_parser_t;
+
+
+static void
+free_nodes(query_node_t * node)
+{
+	if (!node)
+		return;
+
+	free_nodes(node->left);
+	free_nodes(node->right);
+	free(node);
+}
+
+
+static query_node_t *
+node_new(query_parser_t * p, query_type_t type, query_node_t * left, query_node_t * right)
+{
+	query_node_t * node;
+
+	if (!left || (type != QUERY_NOT && !right) || !(node = calloc(1, sizeof(query_node_t)))) {
+		if (!p->error)
+			p->error = "out of memory";
+		free_nodes(left);
+		free_nodes(right);
+		return NULL;
+	}
+
+	node->type = type;
+	node->left = left;
+	node->right = right;
+
+	return node;
+}
+
+
+static void
+skip_spaces(query_parser_t * p)
+{
+	while (*p->p == ' ' || *p->p == '\t' || *p->p == '\n')
+		p->p++;
+}
+
+
+static bool
+ends_word(char c)
+{
+	return !c || c == ' ' || c == '\t' || c == '\n' || c == '(' || c == ')' || c == '"';
+}
+
+
+static bool
+at_keyword(query_parser_t * p, const char * keyword)
+{
+	size_t length = strlen(keyword);
+
+	return !strncmp(p->p, keyword, length) && ends_word(p->p[length]);
+}
+
+
+/* consumes keyword if it is the next word */
+static bool
+keyword(query_parser_t * p, const char * keyword)
+{
+	if (!at_keyword(p, keyword))
+		return false;
+
+	p->p += strlen(keyword);
+	return true;
+}
+
+
+static query_node_t *
+add_term(query_parser_t * p, re_node_t * re)
+{
+	query_node_t * node;
+
+	if (!re) {
+		if (!p->error)
+			p->error = "out of memory";
+		return NULL;
+	}
+
+	if (p->count == DFA_MAX_ATOMS) {
+		p->error = "too many terms";
+		re_free(re);
+		return NULL;
+	}
+
+	if (!(node = calloc(1, sizeof(query_node_t)))) {
+		p->error = "out of memory";
+		re_free(re);
+		return NULL;
+	}
+
+	node->type = QUERY_TERM;
+	node->term = p->count;
+	p->terms[p->count++] = re;
+
+	return node;
+}
+
+
+/* the regular expression up to the closing slash, "\/" being a slash */
+static query_node_t *
+parse_regex(query_parser_t * p)
+{
+	const char * start = ++p->p, * error = NULL;
+	char * pattern, * out;
+	re_node_t * re;
+
+	while (*p->p && *p->p != '/')
+		p->p += (p->p[0] == '\\' && p->p[1]) ? 2 : 1;
+
+	if (!*p->p) {
+		p->error = "unterminated regular expression";
+		return NULL;
+	}
+
+	if (!(out = pattern = malloc(p->p - start + 1))) {
+		p->error = "out of memory";
+		return NULL;
+	}
+
+	for (const char * c = start; c < p->p; c++) {
+		if (c[0] == '\\' && c[1] == '/')
+			c++;
+		*out++ = *c;
+	}
+
+	p->p++;
+
+	re = re_parse(pattern, out - pattern, p->flags & QUERY_IGNORE_CASE ? DFA_IGNORE_CASE : 0, &error);
+	free(pattern);
+
+	if (!re) {
+		p->error = error;
+		return NULL;
+	}
+
+	return add_term(p, re);
+}
+
+
+static query_node_t *
+parse_or(query_parser_t * p);
+
+
+static query_node_t *
+parse_primary(query_parser_t * p)
+{
+	int flags = p->flags & QUERY_IGNORE_CASE ? DFA_IGNORE_CASE : 0;
+	const char * start;
+	query_node_t * node;
+
+	skip_spaces(p);
+
+	switch (*p->p) {
+	case '(':
+		if (++p->depth > QUERY_MAX_DEPTH) {
+			p->error = "too deeply nested";
+			return NULL;
+		}
+
+		p->p++;
+		if (!(node = parse_or(p)))
+			return NULL;
+
+		skip_spaces(p);
+		if (*p->p != ')') {
+			p->error = "missing )";
+			free_nodes(node);
+			return NULL;
+		}
+
+		p->p++;
+		p->depth--;
+
+		return node;
+	case '"':
+		start = ++p->p;
+		while (*p->p && *p->p != '"')
+			p->p++;
+
+		if (!*p->p) {
+			p->error = "unterminated phrase";
+			return NULL;
+		}
+
+		p->p++;
+		return add_term(p, re_literal(start, p->p - 1 - start, flags));
+	case '/':
+		return parse_regex(p);
+	case ')':
+	case '\0':
+		p->error = "expected a term";
+		return NULL;
+	default:
+		start = p->p;
+		while (!ends_word(*p->p))
+			p->p++;
+
+		return add_term(p, re_literal(start, p->p - start, flags));
+	}
+}
+
+
+/* negations are folded as they are read, so a long run of them takes no stack */
+static query_node_t *
+parse_unary(query_parser_t * p)
+{
+	bool negated = false;
+
+	for (;;) {
+		skip_spaces(p);
+		if (!keyword(p, "NOT") && !(*p->p == '-' && !ends_word(p->p[1]) && p->p++))
+			break;
+		negated = !negated;
+	}
+
+	return negated ? node_new(p, QUERY_NOT, parse_primary(p), NULL) : parse_primary(p);
+}
+
+
+static query_node_t *
+parse_and(query_parser_t * p)
+{
+	query_node_t * node = parse_unary(p);
+
+	while (node) {
+		skip_spaces(p);
+
+		if (!*p->p || *p->p == ')' || at_keyword(p, "OR"))
+			break;
+
+		keyword(p, "AND");
+		node = node_new(p, QUERY_AND, node, parse_unary(p));
+	}
+
+	return node;
+}
+
+
+static query_node_t *
+parse_or(query_parser_t * p)
+{
+	query_node_t * node = parse_and(p);
+
+	while (node) {
+		skip_spaces(p);
+		if (!keyword(p, "OR"))
+			break;
+
+		node = node_new(p, QUERY_OR, node, parse_and(p));
+	}
+
+	return node;
+}
+
+
+query_t *
+query_compile(const char * text, int flags)
+{
+	query_parser_t p = { .p = text, .flags = flags };
+	query_t * query = calloc(1, sizeof(query_t));
+
+	if (!query) {
+		perror("Error");
+		return NULL;
+	}
+
+	query->root = parse_or(&p);
+
+	if (query->root) {
+		skip_spaces(&p);
+		if (*p.p) {
+			p.error = "unbalanced )";
+			free_nodes(query->root);
+			query->root = NULL;
+		}
+	}
+
+	if (query->root) {
+		query->num_terms = p.count;
+		query->num_dfas = dfa_compile(p.terms, p.count, &query->dfas);
+		if (query->num_dfas < 0)
+			p.error = "query too large";
+	}
+
+	for (int i = 0; i < p.count; i++)
+		re_free(p.terms[i]);
+
+	if (!query->root || query->num_dfas < 0) {
+		fprintf(stderr, "Invalid query at offset %d: %s\n", (int)(p.p - text), p.error);
+		query_destroy(query);
+		return NULL;
+	}
+
+	return query;
+}
+
+
+static query_value_t
+eval(const query_node_t * node, uint64_t found, bool final)
+{
+	query_value_t left, right;
+
+	switch (node->type) {
+	case QUERY_TERM:
+		if (found & ((uint64_t)1 << node->term))
+			return QUERY_TRUE;
+		return final ? QUERY_FALSE : QUERY_UNKNOWN;
+	case QUERY_NOT:
+		left = eval(node->left, found, final);
+		return left == QUERY_UNKNOWN ? left : (left == QUERY_TRUE ? QUERY_FALSE : QUERY_TRUE);
+	case QUERY_AND:
+		left = eval(node->left, found, final);
+		right = eval(node->right, found, final);
+		if (left == QUERY_FALSE || right == QUERY_FALSE)
+			return QUERY_FALSE;
+		return left == QUERY_TRUE && right == QUERY_TRUE ? QUERY_TRUE : QUERY_UNKNOWN;
+	case QUERY_OR:
+		left = eval(node->left, found, final);
+		right = eval(node->right, found, final);
+		if (left == QUERY_TRUE || right == QUERY_TRUE)
+			return QUERY_TRUE;
+		return left == QUERY_FALSE && right == QUERY_FALSE ? QUERY_FALSE : QUERY_UNKNOWN;
+	}
+
+	return QUERY_UNKNOWN;
+}
+
+
+query_value_t
+query_eval(const query_t * query, uint64_t found, bool final)
+{
+	return eval(query->root, found, final);
+}
+
+
+void
+query_destroy(query_t * query)
+{
+	for (int i = 0; i < query->num_dfas; i++)
+		dfa_destroy(query->dfas[i]);
+
+	free(query->dfas);
+	free_nodes(query->root);
+	free(query);
+}
@@ -0,0 +1,64 @@
+#ifndef QUERY_H
+#define QUERY_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "dfa.h"
+
+
+/* ASCII letters match regardless of case */
+#define	QUERY_IGNORE_CASE	(1 << 0)
+
+
+typedef enum query_value {
+	QUERY_FALSE,
+	QUERY_TRUE,
+	QUERY_UNKNOWN	/* depends on terms that may still show up */
+} query_value_t;
+
+
+typedef struct query_node query_node_t;
+
+
+/*
+ * A boolean combination of terms. Every term is compiled into the automata
+ * up front, so a page is matched in one linear pass whatever the query.
+ * Read-only once compiled, so it can be shared by every thread.
+ */
+typedef struct query {
+	query_node_t * root;
+	int num_terms;
+	int num_dfas;
+	dfa_t * * dfas;		/* term i is reported as bit i of found */
+} query_t;
+
+
+/*
+ * Compiles a query such as
+ *
+ *	crawler AND ("web crawler" OR /spider(s|ing)?/) -python
+ *
+ * Terms are words, "quoted phrases" whose words may be separated by any
+ * whitespace, and /regular expressions/ as described in re_parse(). Terms
+ * next to each other must all match, OR binds looser than AND, and NOT or a
+ * leading '-' negates a term. Prints the error and returns NULL if the
+ * query is malformed.
+ */
+query_t *
+query_compile(const char * text, int flags);
+
+
+/*
+ * Evaluates the query given the terms found so far. Until final, terms that
+ * were not found may still show up, so the result can be QUERY_UNKNOWN.
+ */
+query_value_t
+query_eval(const query_t * query, uint64_t found, bool final);
+
+
+void
+query_destroy(query_t * query);
+
+
+#endif /* QUERY_H */
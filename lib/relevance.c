@@ -0,0 +1,178 @@
+#include <ctype.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "relevance.h"
+
+
+static int
+add_word(char * * words, int count, const char * word, size_t length)
+{
+	char * copy;
+
+	if (length < RELEVANCE_MIN_WORD || count == RELEVANCE_MAX_WORDS)
+		return count;
+
+	if (!(copy = strndup(word, length))) {
+		perror("Error");
+		return count;
+	}
+	for (size_t i = 0; i < length; i++)
+		copy[i] = tolower((unsigned char)copy[i]);
+
+	for (int i = 0; i < count; i++) {
+		if (!strcmp(words[i], copy)) {
+			free(copy);
+			return count;
+		}
+	}
+
+	words[count] = copy;
+	return count + 1;
+}
+
+
+/* skips a quoted phrase or a regular expression, p is on the opening delimiter */
+static const char *
+skip_delimited(const char * p)
+{
+	char delimiter = *p++;
+
+	for (; *p && *p != delimiter; p++)
+		if (*p == '\\' && p[1])
+			p++;
+
+	return *p ? p + 1 : p;
+}
+
+
+/*
+ * Adds the alphanumeric words of text. In a query, the operators are not
+ * words, a negated term is not wanted on a page, and a regular expression
+ * has no words to speak of.
+ */
+static int
+collect_words(char * * words, int count, const char * text, int flags)
+{
+	bool query = flags & RELEVANCE_QUERY, negated = false;
+	const char * p = text, * start;
+	size_t length;
+
+	while (*p) {
+		if (query && (*p == '/' || (negated && *p == '"'))) {
+			p = skip_delimited(p);
+			negated = false;
+			continue;
+		}
+
+		if (query && *p == '-' && (p == text || isspace((unsigned char)p[-1]) || p[-1] == '(')) {
+			negated = true;
+			p++;
+			continue;
+		}
+
+		if (!isalnum((unsigned char)*p)) {
+			p++;
+			continue;
+		}
+
+		for (start = p; isalnum((unsigned char)*p); p++)
+			;
+		length = p - start;
+
+		if (query && length == 3 && !memcmp(start, "NOT", 3)) {
+			negated = true;
+			continue;
+		}
+		if (query && ((length == 3 && !memcmp(start, "AND", 3)) || (length == 2 && !memcmp(start, "OR", 2))))
+			continue;
+
+		if (!negated)
+			count = add_word(words, count, start, length);
+		negated = false;
+	}
+
+	return count;
+}
+
+
+relevance_t *
+relevance_create(char * * texts, int count, int flags)
+{
+	relevance_t * relevance = calloc(1, sizeof(relevance_t));
+	char * words[RELEVANCE_MAX_WORDS];
+	int num_words = 0, i;
+
+	if (!relevance) {
+		perror("Error");
+		return NULL;
+	}
+
+	for (i = 0; i < count; i++)
+		num_words = collect_words(words, num_words, texts[i], flags);
+
+	// an expression of short words is still worth looking for as a whole
+	if (num_words == 0 && !(flags & RELEVANCE_QUERY))
+		for (i = 0; i < count && num_words < RELEVANCE_MAX_WORDS; i++)
+			if (*texts[i] && (words[num_words] = strdup(texts[i])))
+				num_words++;
+
+	if (num_words > 0 && !(relevance->keywords = ac_create(words, num_words, AC_IGNORE_CASE))) {
+		free(relevance);
+		relevance = NULL;
+	}
+
+	for (i = 0; i < num_words; i++)
+		free(words[i]);
+
+	return relevance;
+}
+
+
+typedef struct seen {
+	uint64_t words;
+	int count;
+	int left;
+} seen_t;
+
+
+static bool
+mark_word(int word, size_t end, void * data)
+{
+	seen_t * seen = (seen_t *)data;
+
+	(void)end;
+
+	if (!(seen->words & (1ULL << word))) {
+		seen->words |= 1ULL << word;
+		seen->left--;
+	}
+
+	return seen->left > 0;
+}
+
+
+double
+relevance_score(const relevance_t * relevance, const char * text, size_t length)
+{
+	seen_t seen = { 0, 0, 0 };
+
+	if (!relevance->keywords || !text)
+		return 0;
+
+	seen.count = seen.left = relevance->keywords->count;
+	ac_scan(relevance->keywords, AC_START, text, length, mark_word, &seen);
+
+	return (double)(seen.count - seen.left) / seen.count;
+}
+
+
+void
+relevance_destroy(relevance_t * relevance)
+{
+	if (relevance->keywords)
+		ac_destroy(relevance->keywords);
+	free(relevance);
+}
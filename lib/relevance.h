@@ -0,0 +1,40 @@
+#ifndef RELEVANCE_H
+#define RELEVANCE_H
+
+#include <stdbool.h>
+#include <stddef.h>
+
+#include "ahocorasick.h"
+
+
+#define	RELEVANCE_MAX_WORDS	64
+#define	RELEVANCE_MIN_WORD	3		/* shorter words say little about a page */
+
+/* the texts are queries: operators, negated terms and regular expressions are skipped */
+#define	RELEVANCE_QUERY		(1 << 0)
+
+
+/*
+ * The words of what is searched for, in one case insensitive automaton. A
+ * text is scored by the share of the words it contains, so links whose
+ * text or url mention the expression can be fetched before the others.
+ */
+typedef struct relevance {
+	ac_automaton_t * keywords;	/* NULL if the texts have no words */
+} relevance_t;
+
+
+relevance_t *
+relevance_create(char * * texts, int count, int flags);
+
+
+/* share of the words that occur in text, from 0 to 1 */
+double
+relevance_score(const relevance_t * relevance, const char * text, size_t length);
+
+
+void
+relevance_destroy(relevance_t * relevance);
+
+
+#endif /* RELEVANCE_H */
@@ -0,0 +1,371 @@
+#define _GNU_SOURCE
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define	SEARCH_X86
+#endif
+
+#include "searcher.h"
+
+
+static unsigned char
+fold_ascii(unsigned char c)
+{
+	return (c >= 'A' && c <= 'Z') ? c | 0x20 : c;
+}
+
+
+/*
+ * Folds the two byte sequence b0 b1 if it is an uppercase Latin-1, Greek or
+ * Cyrillic letter. Returns false if b0 does not start such a sequence.
+ */
+static bool
+fold_pair(unsigned char b0, unsigned char b1, unsigned char * f0, unsigned char * f1)
+{
+	*f0 = b0;
+	*f1 = b1;
+
+	if ((b1 & 0xC0) != 0x80)
+		return false;
+
+	switch (b0) {
+	case 0xC3:	/* U+00C0 - U+00DE, except the multiplication sign */
+		if (b1 <= 0x9E && b1 != 0x97)
+			*f1 = b1 | 0x20;
+		return true;
+	case 0xCE:	/* U+0391 - U+03A9 */
+		if (b1 >= 0x91 && b1 <= 0x9F) {
+			*f1 = b1 + 0x20;
+		} else if (b1 >= 0xA0 && b1 <= 0xA9) {
+			*f0 = 0xCF;
+			*f1 = b1 - 0x20;
+		}
+		return true;
+	case 0xD0:	/* U+0400 - U+042F */
+		if (b1 <= 0x8F) {
+			*f0 = 0xD1;
+			*f1 = b1 + 0x10;
+		} else if (b1 <= 0x9F) {
+			*f1 = b1 + 0x20;
+		} else if (b1 <= 0xAF) {
+			*f0 = 0xD1;
+			*f1 = b1 - 0x20;
+		}
+		return true;
+	default:
+		return false;
+	}
+}
+
+
+static void
+fold(const char * src, char * dst, size_t length)
+{
+	const unsigned char * s = (const unsigned char *)src;
+	unsigned char * d = (unsigned char *)dst;
+
+	for (size_t i = 0; i < length; i++) {
+		if (s[i] < 0x80)
+			d[i] = fold_ascii(s[i]);
+		else if (i + 1 < length && fold_pair(s[i], s[i + 1], &d[i], &d[i + 1]))
+			i++;
+		else
+			d[i] = s[i];
+	}
+}
+
+
+/* checks for the pattern at text, which has at least length bytes */
+static inline bool
+verify(const searcher_t * searcher, const char * text)
+{
+	const unsigned char * t = (const unsigned char *)text;
+	const unsigned char * p = (const unsigned char *)searcher->pattern;
+	unsigned char f0, f1;
+	size_t j = 0;
+
+	if (!(searcher->flags & SEARCH_IGNORE_CASE))
+		return !memcmp(text, searcher->pattern, searcher->length);
+
+	while (j < searcher->length) {
+		if (t[j] < 0x80) {
+			if (fold_ascii(t[j]) != p[j])
+				return false;
+			j++;
+		} else if (j + 1 < searcher->length && fold_pair(t[j], t[j + 1], &f0, &f1)) {
+			if (f0 != p[j] || f1 != p[j + 1])
+				return false;
+			j += 2;
+		} else {
+			if (t[j] != p[j])
+				return false;
+			j++;
+		}
+	}
+
+	return true;
+}
+
+
+static ssize_t
+find_scalar_from(const searcher_t * searcher, const char * text, size_t length, size_t i)
+{
+	const unsigned char * t = (const unsigned char *)text;
+	const unsigned char * p = (const unsigned char *)searcher->pattern;
+
+	for (; i + searcher->length <= length; i++) {
+		if ((t[i + searcher->first] | searcher->first_fold) != p[searcher->first] ||
+				(t[i + searcher->last] | searcher->last_fold) != p[searcher->last])
+			continue;
+
+		if (verify(searcher, &text[i]))
+			return i;
+	}
+
+	return -1;
+}
+
+
+/* for folded patterns without an ASCII byte the filter has nothing to test */
+static ssize_t
+find_unfiltered(const searcher_t * searcher, const char * text, size_t length)
+{
+	for (size_t i = 0; i + searcher->length <= length; i++)
+		if (verify(searcher, &text[i]))
+			return i;
+
+	return -1;
+}
+
+
+static ssize_t
+find_scalar(const searcher_t * searcher, const char * text, size_t length)
+{
+	const char * match;
+
+	if (!(searcher->flags & SEARCH_IGNORE_CASE)) {
+		match = memmem(text, length, searcher->pattern, searcher->length);
+		return match ? match - text : -1;
+	}
+
+	return find_scalar_from(searcher, text, length, 0);
+}
+
+
+#ifdef SEARCH_X86
+
+/*
+ * Tests the first and last filter bytes of 16 (32, 64) candidate positions at
+ * once, only the positions where both match are verified.
+ */
+static ssize_t
+find_sse2_from(const searcher_t * searcher, const char * text, size_t length, size_t i)
+{
+	const __m128i first = _mm_set1_epi8(searcher->pattern[searcher->first]);
+	const __m128i last = _mm_set1_epi8(searcher->pattern[searcher->last]);
+	const __m128i first_fold = _mm_set1_epi8(searcher->first_fold);
+	const __m128i last_fold = _mm_set1_epi8(searcher->last_fold);
+	size_t pos;
+	unsigned mask;
+
+	for (; i + searcher->last + 16 <= length; i += 16) {
+		__m128i a = _mm_loadu_si128((const __m128i *)&text[i + searcher->first]);
+		__m128i b = _mm_loadu_si128((const __m128i *)&text[i + searcher->last]);
+
+		mask = _mm_movemask_epi8(_mm_and_si128(
+			_mm_cmpeq_epi8(_mm_or_si128(a, first_fold), first),
+			_mm_cmpeq_epi8(_mm_or_si128(b, last_fold), last)));
+
+		while (mask) {
+			pos = i + __builtin_ctz(mask);
+			if (pos + searcher->length <= length && verify(searcher, &text[pos]))
+				return pos;
+			mask &= mask - 1;
+		}
+	}
+
+	return find_scalar_from(searcher, text, length, i);
+}
+
+
+static ssize_t
+find_sse2(const searcher_t * searcher, const char * text, size_t length)
+{
+	return find_sse2_from(searcher, text, length, 0);
+}
+
+
+__attribute__((target("avx2")))
+static ssize_t
+find_avx2_from(const searcher_t * searcher, const char * text, size_t length, size_t i)
+{
+	const __m256i first = _mm256_set1_epi8(searcher->pattern[searcher->first]);
+	const __m256i last = _mm256_set1_epi8(searcher->pattern[searcher->last]);
+	const __m256i first_fold = _mm256_set1_epi8(searcher->first_fold);
+	const __m256i last_fold = _mm256_set1_epi8(searcher->last_fold);
+	size_t pos;
+	unsigned mask;
+
+	for (; i + searcher->last + 32 <= length; i += 32) {
+		__m256i a = _mm256_loadu_si256((const __m256i *)&text[i + searcher->first]);
+		__m256i b = _mm256_loadu_si256((const __m256i *)&text[i + searcher->last]);
+
+		mask = _mm256_movemask_epi8(_mm256_and_si256(
+			_mm256_cmpeq_epi8(_mm256_or_si256(a, first_fold), first),
+			_mm256_cmpeq_epi8(_mm256_or_si256(b, last_fold), last)));
+
+		while (mask) {
+			pos = i + __builtin_ctz(mask);
+			if (pos + searcher->length <= length && verify(searcher, &text[pos]))
+				return pos;
+			mask &= mask - 1;
+		}
+	}
+
+	// the remainder is too short for a full vector, try a narrower one
+	return find_sse2_from(searcher, text, length, i);
+}
+
+
+__attribute__((target("avx2")))
+static ssize_t
+find_avx2(const searcher_t * searcher, const char * text, size_t length)
+{
+	return find_avx2_from(searcher, text, length, 0);
+}
+
+
+__attribute__((target("avx512f,avx512bw")))
+static ssize_t
+find_avx512_from(const searcher_t * searcher, const char * text, size_t length, size_t i)
+{
+	const __m512i first = _mm512_set1_epi8(searcher->pattern[searcher->first]);
+	const __m512i last = _mm512_set1_epi8(searcher->pattern[searcher->last]);
+	const __m512i first_fold = _mm512_set1_epi8(searcher->first_fold);
+	const __m512i last_fold = _mm512_set1_epi8(searcher->last_fold);
+	size_t pos;
+	uint64_t mask;
+
+	for (; i + searcher->last + 64 <= length; i += 64) {
+		__m512i a = _mm512_loadu_si512((const void *)&text[i + searcher->first]);
+		__m512i b = _mm512_loadu_si512((const void *)&text[i + searcher->last]);
+
+		mask = _mm512_cmpeq_epi8_mask(_mm512_or_si512(a, first_fold), first) &
+			_mm512_cmpeq_epi8_mask(_mm512_or_si512(b, last_fold), last);
+
+		while (mask) {
+			pos = i + __builtin_ctzll(mask);
+			if (pos + searcher->length <= length && verify(searcher, &text[pos]))
+				return pos;
+			mask &= mask - 1;
+		}
+	}
+
+	return find_avx2_from(searcher, text, length, i);
+}
+
+
+__attribute__((target("avx512f,avx512bw")))
+static ssize_t
+find_avx512(const searcher_t * searcher, const char * text, size_t length)
+{
+	return find_avx512_from(searcher, text, length, 0);
+}
+
+#endif /* SEARCH_X86 */
+
+
+static ssize_t
+find_empty(const searcher_t * searcher, const char * text, size_t length)
+{
+	(void)searcher;
+	(void)text;
+	(void)length;
+
+	return 0;
+}
+
+
+searcher_t *
+searcher_create(const char * pattern, int flags)
+{
+	searcher_t * searcher = calloc(1, sizeof(searcher_t));
+	bool filter = true;
+	size_t i;
+
+	if (!searcher) {
+		perror("Error");
+		return NULL;
+	}
+
+	searcher->length = strlen(pattern);
+	searcher->flags = flags;
+	searcher->pattern = malloc(searcher->length + 1);
+	if (!searcher->pattern) {
+		perror("Error");
+		free(searcher);
+		return NULL;
+	}
+
+	if (flags & SEARCH_IGNORE_CASE)
+		fold(pattern, searcher->pattern, searcher->length);
+	else
+		memcpy(searcher->pattern, pattern, searcher->length);
+	searcher->pattern[searcher->length] = '\0';
+
+	searcher->first = 0;
+	searcher->last = searcher->length ? searcher->length - 1 : 0;
+
+	// folding changes non-ASCII bytes, so when ignoring case the filter can
+	// only test ASCII positions; letters are tested with their case bit set
+	if (flags & SEARCH_IGNORE_CASE) {
+		for (i = 0; i < searcher->length && (unsigned char)searcher->pattern[i] >= 0x80; i++);
+		searcher->first = i;
+
+		for (i = searcher->length; i > 0 && (unsigned char)searcher->pattern[i - 1] >= 0x80; i--);
+		searcher->last = i ? i - 1 : 0;
+
+		filter = searcher->first < searcher->length;
+
+		if (!filter) {
+			searcher->first = 0;
+			searcher->last = 0;
+		} else {
+			if (searcher->pattern[searcher->first] >= 'a' && searcher->pattern[searcher->first] <= 'z')
+				searcher->first_fold = 0x20;
+			if (searcher->pattern[searcher->last] >= 'a' && searcher->pattern[searcher->last] <= 'z')
+				searcher->last_fold = 0x20;
+		}
+	}
+
+	if (searcher->length == 0) {
+		searcher->find = find_empty;
+	} else if (!filter) {
+		searcher->find = find_unfiltered;
+#ifdef SEARCH_X86
+	} else if (__builtin_cpu_supports("avx512f") && __builtin_cpu_supports("avx512bw")) {
+		searcher->find = find_avx512;
+	} else if (__builtin_cpu_supports("avx2")) {
+		searcher->find = find_avx2;
+	} else if (__builtin_cpu_supports("sse2")) {
+		searcher->find = find_sse2;
+#endif
+	} else {
+		searcher->find = find_scalar;
+	}
+
+	return searcher;
+}
+
+
+void
+searcher_destroy(searcher_t * searcher)
+{
+	free(searcher->pattern);
+	free(searcher);
+}
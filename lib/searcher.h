@@ -0,0 +1,52 @@
+#ifndef SEARCHER_H
+#define SEARCHER_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <sys/types.h>
+
+
+/*
+ * Folds ASCII letters and the two byte UTF-8 Latin-1, Greek and Cyrillic
+ * letters. Folding keeps the length of the text, so offsets are unchanged.
+ */
+#define	SEARCH_IGNORE_CASE	(1 << 0)
+
+
+typedef struct searcher searcher_t;
+
+
+/* finds the first occurrence of the pattern in text, -1 if there is none */
+typedef ssize_t (*searcher_find_function)(const searcher_t *, const char *, size_t);
+
+
+/*
+ * A pattern compiled once for repeated searches. It is never modified after
+ * searcher_create(), so one searcher can be shared by every thread.
+ */
+struct searcher {
+	char * pattern;		/* folded when SEARCH_IGNORE_CASE is set */
+	size_t length;
+	int flags;
+	size_t first, last;	/* positions of the bytes the vector filter tests */
+	unsigned char first_fold, last_fold;	/* or'ed into text bytes before the test */
+	searcher_find_function find;
+};
+
+
+searcher_t *
+searcher_create(const char * pattern, int flags);
+
+
+static inline ssize_t
+searcher_find(const searcher_t * searcher, const char * text, size_t length)
+{
+	return searcher->find(searcher, text, length);
+}
+
+
+void
+searcher_destroy(searcher_t * searcher);
+
+
+#endif /* SEARCHER_H */
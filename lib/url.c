@@ -0,0 +1,266 @@
+#define _GNU_SOURCE
+
+#include <ctype.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "hash.h"
+#include "url.h"
+
+
+uint64_t
+url_string_hash(const char * str, size_t length)
+{
+	return hash_bytes(str, length, 0);
+}
+
+
+url_t *
+url_init(void * memory, const char * str, size_t length)
+{
+	url_t * url = (url_t *)memory;
+
+	memcpy(url->str, str, length);
+	url->str[length] = '\0';
+	url->length = length;
+	url->hash = url_string_hash(str, length);
+
+	return url;
+}
+
+
+url_t *
+url_create(const char * str, size_t length)
+{
+	url_t * url = malloc(url_size(length));
+
+	if (!url) {
+		perror("Error");
+		return NULL;
+	}
+
+	return url_init(url, str, length);
+}
+
+
+static inline int
+hex_value(char c)
+{
+	if (c >= '0' && c <= '9')
+		return c - '0';
+	if (c >= 'a' && c <= 'f')
+		return c - 'a' + 10;
+	if (c >= 'A' && c <= 'F')
+		return c - 'A' + 10;
+
+	return -1;
+}
+
+
+static inline bool
+unreserved(char c)
+{
+	return isalnum((unsigned char)c) || c == '-' || c == '.' || c == '_' || c == '~';
+}
+
+
+/*
+ * Copies str to out with the escapes of unreserved characters decoded, as
+ * they mean the same, and the others in uppercase. Returns the end of out.
+ */
+static char *
+normalize_escapes(const char * str, const char * end, char * out)
+{
+	int high, low;
+
+	while (str < end) {
+		if (*str == '%' && end - str >= 3 && (high = hex_value(str[1])) >= 0 && (low = hex_value(str[2])) >= 0) {
+			if (unreserved((char)(high << 4 | low))) {
+				*out++ = (char)(high << 4 | low);
+			} else {
+				*out++ = '%';
+				*out++ = toupper((unsigned char)str[1]);
+				*out++ = toupper((unsigned char)str[2]);
+			}
+			str += 3;
+		} else {
+			*out++ = *str++;
+		}
+	}
+
+	return out;
+}
+
+
+/* removes "." and ".." segments of path in place, as RFC 3986 resolves them */
+static size_t
+remove_dot_segments(char * path, size_t length)
+{
+	char * in = path, * end = path + length, * out = path, * segment;
+	size_t n;
+
+	while (in < end) {
+		// in is on the '/' before a segment
+		segment = in + 1;
+		for (in = segment; in < end && *in != '/'; in++)
+			;
+		n = in - segment;
+
+		if (n == 1 && segment[0] == '.') {
+			if (in == end)
+				*out++ = '/';
+		} else if (n == 2 && segment[0] == '.' && segment[1] == '.') {
+			while (out > path && *--out != '/')
+				;
+			if (in == end)
+				*out++ = '/';
+		} else {
+			*out++ = '/';
+			memmove(out, segment, n);
+			out += n;
+		}
+	}
+
+	if (out == path)
+		*out++ = '/';
+
+	return out - path;
+}
+
+
+static bool
+stripped(const char * name, size_t length, char * const * strip, int num_strip)
+{
+	size_t n;
+
+	for (int i = 0; i < num_strip; i++) {
+		n = strlen(strip[i]);
+		if (n > 0 && strip[i][n - 1] == '*' ? length >= n - 1 && !memcmp(name, strip[i], n - 1) :
+				length == n && !memcmp(name, strip[i], n))
+			return true;
+	}
+
+	return false;
+}
+
+
+/* drops the stripped and empty parameters of the query in place */
+static size_t
+strip_params(char * query, size_t length, char * const * strip, int num_strip)
+{
+	char * in = query, * end = query + length, * out = query, * param;
+	size_t n, name;
+
+	while (in < end) {
+		param = in;
+		for (; in < end && *in != '&'; in++)
+			;
+		n = in - param;
+		if (in < end)
+			in++;
+
+		for (name = 0; name < n && param[name] != '='; name++)
+			;
+		if (n == 0 || stripped(param, name, strip, num_strip))
+			continue;
+
+		if (out > query)
+			*out++ = '&';
+		memmove(out, param, n);
+		out += n;
+	}
+
+	return out - query;
+}
+
+
+size_t
+url_canonicalize(const char * str, size_t length, char * out, char * const * strip, int num_strip)
+{
+	const char * end = str + length, * p, * host, * port, * authority_end;
+	char * o = out, * path;
+	size_t n;
+	bool https;
+
+	// a "://" in the path or the query is not the end of a scheme
+	for (p = str; p < end && !strchr(":/?#", *p); p++)
+		;
+	if (end - p < 3 || memcmp(p, "://", 3)) {
+		memcpy(out, str, length);
+		return length;
+	}
+
+	for (; str < p; str++)
+		*o++ = tolower((unsigned char)*str);
+	https = o - out == 5 && !memcmp(out, "https", 5);
+	o = mempcpy(o, "://", 3);
+	str += 3;
+
+	for (authority_end = str; authority_end < end && !strchr("/?#", *authority_end); authority_end++)
+		;
+
+	// user information is kept as it is
+	for (host = authority_end; host > str && host[-1] != '@'; host--)
+		;
+	o = mempcpy(o, str, host - str);
+
+	// the colons of an IPv6 address are not the port's
+	port = host;
+	if (port < authority_end && *port == '[')
+		for (; port < authority_end && *port != ']'; port++)
+			*o++ = tolower((unsigned char)*port);
+	for (; port < authority_end && *port != ':'; port++)
+		*o++ = tolower((unsigned char)*port);
+
+	if (port < authority_end) {
+		n = authority_end - port - 1;
+		if (n > 0 && !(n == 2 && !https && !memcmp(port + 1, "80", 2)) && !(n == 3 && https && !memcmp(port + 1, "443", 3)))
+			o = mempcpy(o, port, n + 1);
+	}
+	str = authority_end;
+
+	for (p = str; p < end && *p != '?' && *p != '#'; p++)
+		;
+	path = o;
+	if (str < p && *str == '/') {
+		o = normalize_escapes(str, p, o);
+		o = path + remove_dot_segments(path, o - path);
+	} else {
+		*o++ = '/';
+	}
+	str = p;
+
+	if (str < end && *str == '?') {
+		for (p = ++str; p < end && *p != '#'; p++)
+			;
+		*o++ = '?';
+		path = o;
+		o = normalize_escapes(str, p, o);
+		o = path + strip_params(path, o - path, strip, num_strip);
+		// nothing left of the query
+		if (o == path)
+			o--;
+	}
+
+	return o - out;
+}
+
+
+size_t
+url_origin_length(const url_t * url)
+{
+	const char * host = strstr(url->str, "://"), * path;
+
+	if (!host)
+		return url->length;
+
+	path = strchr(host + 3, '/');
+	return path ? (size_t)(path - url->str) : url->length;
+}
+
+
+void
+url_free(url_t * url)
+{
+	free(url);
+}
@@ -0,0 +1,77 @@
+#ifndef URL_H
+#define URL_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+
+
+/*
+ * A url string with its hash, computed once when the url is created. The
+ * frontier and the visited set both use the stored hash, so a url is only
+ * ever hashed once however many times it is looked up.
+ */
+typedef struct url {
+	uint64_t hash;
+	size_t length;
+	char str[];		/* nul terminated */
+} url_t;
+
+
+#define	URL_CANONICAL_EXTRA	1	/* bytes a canonical url may take over the url: the path of a bare host */
+
+
+static inline size_t
+url_size(size_t length)
+{
+	return sizeof(url_t) + length + 1;
+}
+
+
+/* hash of the url str, the same that url_create() stores */
+uint64_t
+url_string_hash(const char * str, size_t length);
+
+
+/* lays out a url of the first length bytes of str in memory of url_size(length) bytes */
+url_t *
+url_init(void * memory, const char * str, size_t length);
+
+
+/* copies the first length bytes of str, free with url_free() */
+url_t *
+url_create(const char * str, size_t length);
+
+
+/*
+ * Writes the canonical form of the absolute url str to out, which must
+ * hold length + URL_CANONICAL_EXTRA bytes, and returns its length. The
+ * scheme and host are lowercased, a default port is dropped, an empty
+ * path becomes "/", dot segments are removed, percent-encoded unreserved
+ * characters are decoded and the other escapes uppercased, and the
+ * fragment is dropped. So are the query parameters named in strip, where
+ * a name ending in '*' stands for every name it starts, and the query if
+ * none is left.
+ */
+size_t
+url_canonicalize(const char * str, size_t length, char * out, char * const * strip, int num_strip);
+
+
+static inline bool
+url_equal(const url_t * a, const url_t * b)
+{
+	return a->hash == b->hash && a->length == b->length && !memcmp(a->str, b->str, a->length);
+}
+
+
+/* length of the scheme://host:port part, the whole url if it has no path */
+size_t
+url_origin_length(const url_t * url);
+
+
+void
+url_free(url_t * url);
+
+
+#endif /* URL_H */
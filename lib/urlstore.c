@@ -0,0 +1,464 @@
+#define _GNU_SOURCE
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "urlstore.h"
+#include "url.h"
+
+
+#define LOCK(lock)		pthread_mutex_lock(&lock);
+#define UNLOCK(lock)	pthread_mutex_unlock(&lock);
+
+#define	BLOCK_URLS		(1 << URL_STORE_BLOCK_BITS)
+#define	PAGE_SIZE		(1 << URL_STORE_PAGE_BITS)
+#define	SHARD_BITS		6		/* log2(URL_STORE_SHARDS) */
+#define	MIN_CAPACITY	64
+#define	VARINT_MAX		5		/* bytes of a 32-bit varint */
+
+
+static inline char *
+put_varint(char * p, uint32_t value)
+{
+	while (value >= 0x80) {
+		*p++ = (char)(value | 0x80);
+		value >>= 7;
+	}
+	*p++ = (char)value;
+
+	return p;
+}
+
+
+static inline const char *
+get_varint(const char * p, uint32_t * value)
+{
+	uint32_t result = 0;
+	int shift = 0;
+
+	while ((unsigned char)*p & 0x80) {
+		result |= (uint32_t)((unsigned char)*p++ & 0x7f) << shift;
+		shift += 7;
+	}
+	*value = result | (uint32_t)(unsigned char)*p++ << shift;
+
+	return p;
+}
+
+
+/* the scheme and authority, up to the path */
+static size_t
+origin_length(const char * str, size_t length)
+{
+	const char * p = memmem(str, length, "://", 3), * end = str + length;
+
+	if (!p)
+		return 0;
+
+	for (p += 3; p < end && *p != '/' && *p != '?' && *p != '#'; p++)
+		;
+
+	return p - str;
+}
+
+
+url_store_t *
+url_store_create(void)
+{
+	url_store_t * store = calloc(1, sizeof(url_store_t));
+
+	if (!store) {
+		perror("Error");
+		return NULL;
+	}
+
+	if (!(store->arena = arena_create())) {
+		free(store);
+		return NULL;
+	}
+
+	pthread_mutex_init(&store->lock, NULL);
+	for (int i = 0; i < URL_STORE_SHARDS; i++)
+		pthread_mutex_init(&store->shards[i].lock, NULL);
+
+	return store;
+}
+
+
+static inline store_host_t *
+host_of(url_store_t * store, uint32_t host)
+{
+	return &store->hosts[host >> URL_STORE_PAGE_BITS][host & (PAGE_SIZE - 1)];
+}
+
+
+/* a full block, NULL if it is still being filled */
+static inline const char *
+sealed_block(url_store_t * store, uint32_t block)
+{
+	char * * page = __atomic_load_n(&store->blocks[block >> URL_STORE_PAGE_BITS], __ATOMIC_ACQUIRE);
+
+	return page ? __atomic_load_n(&page[block & (PAGE_SIZE - 1)], __ATOMIC_ACQUIRE) : NULL;
+}
+
+
+/*
+ * Rebuilds url index of a block. Each path is the beginning and the end of
+ * the one before it, with the bytes that differ in between: a url is the
+ * length of the beginning, the length of the end shifted left by one, its
+ * low bit set if the host changes, the host if so, then the bytes between.
+ */
+static size_t
+decode(url_store_t * store, const char * block, uint32_t index, char * out)
+{
+	uint32_t host = 0, shared, rear, n;
+	size_t path_length = 0;
+	store_host_t * h;
+
+	for (uint32_t i = 0; i <= index; i++) {
+		block = get_varint(block, &shared);
+		block = get_varint(block, &rear);
+		if (rear & 1)
+			block = get_varint(block, &host);
+		rear >>= 1;
+		block = get_varint(block, &n);
+		memmove(out + shared + n, out + path_length - rear, rear);
+		memcpy(out + shared, block, n);
+		path_length = shared + n + rear;
+		block += n;
+	}
+
+	h = host_of(store, host);
+	memmove(out + h->length, out, path_length);
+	memcpy(out, h->origin, h->length);
+
+	return h->length + path_length;
+}
+
+
+size_t
+url_store_get(url_store_t * store, uint32_t id, char * out)
+{
+	uint32_t block = id >> URL_STORE_BLOCK_BITS, index = id & (BLOCK_URLS - 1);
+	const char * data;
+	size_t length;
+
+	if ((data = sealed_block(store, block)))
+		return decode(store, data, index, out);
+
+	LOCK(store->lock);
+	// sealed meanwhile, the open block already holds the next urls
+	if ((data = sealed_block(store, block)))
+		length = decode(store, data, index, out);
+	else
+		length = decode(store, store->open, index, out);
+	UNLOCK(store->lock);
+
+	return length;
+}
+
+
+static bool
+grow_hosts(url_store_t * store)
+{
+	size_t capacity = store->host_capacity ? store->host_capacity * 2 : MIN_CAPACITY, j;
+	uint32_t * index = calloc(capacity, sizeof(uint32_t));
+
+	if (!index) {
+		perror("Error");
+		return false;
+	}
+
+	for (uint32_t i = 0; i < store->num_hosts; i++) {
+		for (j = host_of(store, i)->hash & (capacity - 1); index[j]; j = (j + 1) & (capacity - 1))
+			;
+		index[j] = i + 1;
+	}
+
+	free(store->host_index);
+	store->host_index = index;
+	store->host_capacity = capacity;
+
+	return true;
+}
+
+
+/* the number of the origin of a url, added if new, URL_STORE_NONE on failure */
+static uint32_t
+get_host(url_store_t * store, const char * origin, size_t length)
+{
+	uint64_t hash = url_string_hash(origin, length);
+	size_t mask = store->host_capacity - 1, j;
+	store_host_t * host;
+	uint32_t id;
+
+	if (store->host_capacity) {
+		for (j = hash & mask; store->host_index[j]; j = (j + 1) & mask) {
+			host = host_of(store, store->host_index[j] - 1);
+			if (host->hash == hash && host->length == length && !memcmp(host->origin, origin, length))
+				return store->host_index[j] - 1;
+		}
+	}
+
+	id = store->num_hosts;
+	if (id == (size_t)URL_STORE_HOST_PAGES * PAGE_SIZE)
+		return URL_STORE_NONE;
+
+	if ((id + 1) * 2 > store->host_capacity && !grow_hosts(store))
+		return URL_STORE_NONE;
+
+	if (!store->hosts[id >> URL_STORE_PAGE_BITS] &&
+			!(store->hosts[id >> URL_STORE_PAGE_BITS] = calloc(PAGE_SIZE, sizeof(store_host_t)))) {
+		perror("Error");
+		return URL_STORE_NONE;
+	}
+
+	host = host_of(store, id);
+	if (!(host->origin = arena_alloc(store->arena, length)))
+		return URL_STORE_NONE;
+	memcpy(host->origin, origin, length);
+	host->length = length;
+	host->hash = hash;
+
+	mask = store->host_capacity - 1;
+	for (j = hash & mask; store->host_index[j]; j = (j + 1) & mask)
+		;
+	store->host_index[j] = id + 1;
+	store->num_hosts++;
+
+	return id;
+}
+
+
+/* moves a full block to the arena, where decoding finds it without the lock */
+static bool
+seal_block(url_store_t * store, uint32_t block)
+{
+	char * * * page = &store->blocks[block >> URL_STORE_PAGE_BITS], * * slots, * data;
+
+	// readers load the page without the lock, see sealed_block()
+	if (!*page) {
+		if (!(slots = calloc(PAGE_SIZE, sizeof(char *)))) {
+			perror("Error");
+			return false;
+		}
+		__atomic_store_n(page, slots, __ATOMIC_RELEASE);
+	}
+
+	if (!(data = arena_alloc(store->arena, store->open_length)))
+		return false;
+	memcpy(data, store->open, store->open_length);
+
+	__atomic_store_n(&(*page)[block & (PAGE_SIZE - 1)], data, __ATOMIC_RELEASE);
+	store->open_length = 0;
+
+	return true;
+}
+
+
+/* appends a url to the open block, returns its id or URL_STORE_NONE */
+static uint32_t
+append(url_store_t * store, const char * str, size_t length)
+{
+	size_t origin = origin_length(str, length), path_length = length - origin, shared = 0, rear = 0, n, needed;
+	const char * path = str + origin;
+	uint32_t host, id = URL_STORE_NONE;
+	bool new_host;
+	char * open;
+
+	LOCK(store->lock);
+
+	// a full block that could not be sealed is still the open one
+	if (store->open_length && !(store->count & (BLOCK_URLS - 1)) &&
+			!seal_block(store, (store->count >> URL_STORE_BLOCK_BITS) - 1))
+		goto out;
+
+	if (store->count == URL_STORE_NONE || (host = get_host(store, str, origin)) == URL_STORE_NONE)
+		goto out;
+
+	// the first url of a block is whole, with its host, so a block decodes
+	// on its own
+	if (store->count & (BLOCK_URLS - 1)) {
+		while (shared < path_length && shared < store->last_length && path[shared] == store->last[shared])
+			shared++;
+		while (shared + rear < path_length && shared + rear < store->last_length &&
+				path[path_length - rear - 1] == store->last[store->last_length - rear - 1])
+			rear++;
+	}
+	n = path_length - shared - rear;
+
+	needed = store->open_length + 4 * VARINT_MAX + n;
+	if (needed > store->open_capacity) {
+		if (!(open = realloc(store->open, needed * 2))) {
+			perror("Error");
+			goto out;
+		}
+		store->open = open;
+		store->open_capacity = needed * 2;
+	}
+
+	new_host = !(store->count & (BLOCK_URLS - 1)) || host != store->last_host;
+	open = store->open + store->open_length;
+	open = put_varint(open, shared);
+	open = put_varint(open, rear << 1 | new_host);
+	if (new_host)
+		open = put_varint(open, host);
+	open = put_varint(open, n);
+	memcpy(open, path + shared, n);
+	store->open_length = open + n - store->open;
+
+	memcpy(store->last, path, path_length);
+	store->last_length = path_length;
+	store->last_host = host;
+
+	id = store->count++;
+	if (!(store->count & (BLOCK_URLS - 1)))
+		seal_block(store, id >> URL_STORE_BLOCK_BITS);
+
+out:
+	UNLOCK(store->lock);
+
+	return id;
+}
+
+
+static bool
+equal(url_store_t * store, uint32_t id, const char * str, size_t length)
+{
+	char url[URL_STORE_MAX];
+
+	return url_store_get(store, id, url) == length && !memcmp(url, str, length);
+}
+
+
+/* doubles the index of a shard, the hashes come from decoding its urls */
+static bool
+shard_grow(url_store_t * store, store_shard_t * shard)
+{
+	size_t capacity = shard->capacity ? shard->capacity * 2 : MIN_CAPACITY, mask = capacity - 1, j, length;
+	uint32_t * ids = calloc(capacity, sizeof(uint32_t));
+	uint8_t * tags = malloc(capacity);
+	char url[URL_STORE_MAX];
+	uint64_t hash;
+
+	if (!ids || !tags) {
+		perror("Error");
+		free(ids);
+		free(tags);
+		return false;
+	}
+
+	for (size_t i = 0; i < shard->capacity; i++) {
+		if (!shard->ids[i])
+			continue;
+
+		length = url_store_get(store, shard->ids[i] - 1, url);
+		hash = url_string_hash(url, length);
+		for (j = (hash >> SHARD_BITS) & mask; ids[j]; j = (j + 1) & mask)
+			;
+		ids[j] = shard->ids[i];
+		tags[j] = shard->tags[i];
+	}
+
+	free(shard->ids);
+	free(shard->tags);
+	shard->ids = ids;
+	shard->tags = tags;
+	shard->capacity = capacity;
+
+	return true;
+}
+
+
+bool
+url_store_add(url_store_t * store, const char * str, size_t length, uint32_t * id)
+{
+	uint64_t hash = url_string_hash(str, length);
+	store_shard_t * shard = &store->shards[hash & (URL_STORE_SHARDS - 1)];
+	uint8_t tag = hash >> 56;
+	bool added = false;
+	size_t j, mask;
+
+	*id = URL_STORE_NONE;
+	if (length > URL_STORE_MAX)
+		return false;
+
+	LOCK(shard->lock);
+
+	mask = shard->capacity - 1;
+	for (j = (hash >> SHARD_BITS) & mask; shard->capacity && shard->ids[j]; j = (j + 1) & mask) {
+		if (shard->tags[j] == tag && equal(store, shard->ids[j] - 1, str, length)) {
+			*id = shard->ids[j] - 1;
+			goto out;
+		}
+	}
+
+	// up to a load of 7/8, a slot is 5 bytes
+	if ((shard->count + 1) * 8 > shard->capacity * 7) {
+		if (!shard_grow(store, shard))
+			goto out;
+		mask = shard->capacity - 1;
+		for (j = (hash >> SHARD_BITS) & mask; shard->ids[j]; j = (j + 1) & mask)
+			;
+	}
+
+	if ((*id = append(store, str, length)) == URL_STORE_NONE)
+		goto out;
+
+	shard->ids[j] = *id + 1;
+	shard->tags[j] = tag;
+	shard->count++;
+	added = true;
+
+out:
+	UNLOCK(shard->lock);
+
+	return added;
+}
+
+
+size_t
+url_store_size(url_store_t * store)
+{
+	return store->count;
+}
+
+
+size_t
+url_store_memory(url_store_t * store)
+{
+	size_t memory = arena_memory(store->arena) + store->open_capacity + store->host_capacity * sizeof(uint32_t);
+
+	for (int i = 0; i < URL_STORE_SHARDS; i++)
+		memory += store->shards[i].capacity * (sizeof(uint32_t) + sizeof(uint8_t));
+	for (int i = 0; i < URL_STORE_BLOCK_PAGES; i++)
+		if (store->blocks[i])
+			memory += PAGE_SIZE * sizeof(char *);
+	for (int i = 0; i < URL_STORE_HOST_PAGES; i++)
+		if (store->hosts[i])
+			memory += PAGE_SIZE * sizeof(store_host_t);
+
+	return memory;
+}
+
+
+void
+url_store_destroy(url_store_t * store)
+{
+	for (int i = 0; i < URL_STORE_SHARDS; i++) {
+		pthread_mutex_destroy(&store->shards[i].lock);
+		free(store->shards[i].ids);
+		free(store->shards[i].tags);
+	}
+	for (int i = 0; i < URL_STORE_BLOCK_PAGES; i++)
+		free(store->blocks[i]);
+	for (int i = 0; i < URL_STORE_HOST_PAGES; i++)
+		free(store->hosts[i]);
+
+	pthread_mutex_destroy(&store->lock);
+	arena_destroy(store->arena);
+	free(store->host_index);
+	free(store->open);
+	free(store);
+}
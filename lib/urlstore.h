@@ -0,0 +1,108 @@
+#ifndef URLSTORE_H
+#define URLSTORE_H
+
+#include <pthread.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "arena.h"
+
+
+#define	URL_STORE_BLOCK_BITS	4		/* 16 urls front coded against each other */
+#define	URL_STORE_MAX			8192	/* longest url stored */
+#define	URL_STORE_SHARDS		64
+#define	URL_STORE_NONE			UINT32_MAX
+
+#define	URL_STORE_PAGE_BITS		12		/* pointers per page of blocks or hosts */
+#define	URL_STORE_BLOCK_PAGES	(1 << (32 - URL_STORE_BLOCK_BITS - URL_STORE_PAGE_BITS))	/* enough for every id */
+#define	URL_STORE_HOST_PAGES	(1 << 12)	/* up to 16M hosts */
+
+
+/* the part of a url before its path, once per store */
+typedef struct store_host {
+	uint64_t hash;
+	uint32_t length;
+	char * origin;		/* in the arena */
+} store_host_t;
+
+
+/*
+ * Finds urls by content: a byte of each url's hash next to its id, so most
+ * slots are passed over without decoding the url they hold.
+ */
+typedef struct store_shard {
+	pthread_mutex_t lock;
+	uint32_t * ids;		/* id + 1, 0 if empty */
+	uint8_t * tags;
+	size_t capacity;	/* a power of two */
+	size_t count;
+} __attribute__((aligned(64))) store_shard_t;
+
+
+/*
+ * Urls interned by 32-bit ids, in the order they were added, in a third to
+ * a fifth of the bytes of the strings. Each origin is stored once and a
+ * url holds its number; paths are coded in blocks of 16 urls, each keeping
+ * only the bytes between the beginning and the end it shares with the url
+ * before it. Decoding a url reads at most one block.
+ *
+ * The block being filled is kept apart under the store lock; full blocks
+ * are copied to the arena and never change again, so they are decoded
+ * without locks. Pages of block and host pointers are allocated once and
+ * never move.
+ *
+ * Adds and decodes may run concurrently from any thread.
+ */
+typedef struct url_store {
+	pthread_mutex_t lock;		/* of adding urls and hosts */
+	arena_t * arena;
+	char * * blocks[URL_STORE_BLOCK_PAGES];	/* full blocks, by block number */
+	store_host_t * hosts[URL_STORE_HOST_PAGES];
+	uint32_t num_hosts;
+	uint32_t * host_index;		/* host + 1, 0 if empty */
+	size_t host_capacity;
+	char * open;				/* the block being filled */
+	size_t open_length;
+	size_t open_capacity;
+	uint32_t count;				/* urls */
+	char last[URL_STORE_MAX];	/* path of the last url added */
+	size_t last_length;
+	uint32_t last_host;
+	store_shard_t shards[URL_STORE_SHARDS];
+} url_store_t;
+
+
+url_store_t *
+url_store_create(void);
+
+
+/*
+ * Interns the url str. Returns true and sets id if the url is new, false
+ * and sets id to the url's id if it was added before, or to URL_STORE_NONE
+ * if it cannot be stored.
+ */
+bool
+url_store_add(url_store_t * store, const char * str, size_t length, uint32_t * id);
+
+
+/* writes the url id to out, of URL_STORE_MAX bytes, and returns its length */
+size_t
+url_store_get(url_store_t * store, uint32_t id, char * out);
+
+
+/* urls stored, not synchronized */
+size_t
+url_store_size(url_store_t * store);
+
+
+/* bytes taken by the urls and the index, not synchronized */
+size_t
+url_store_memory(url_store_t * store);
+
+
+void
+url_store_destroy(url_store_t * store);
+
+
+#endif /* URLSTORE_H */
@@ -0,0 +1,315 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "visited.h"
+
+
+#define LOCK(lock)		pthread_mutex_lock(&lock);
+#define UNLOCK(lock)	pthread_mutex_unlock(&lock);
+
+#define	SHARD_BITS			6	/* log2(VISITED_SHARDS) */
+#define	MIN_CAPACITY		64
+#define	PREFETCH_DISTANCE	16	/* hashes ahead in visited_add_all */
+
+
+static size_t
+round_up(size_t size)
+{
+	size_t power = MIN_CAPACITY;
+
+	while (power < size)
+		power <<= 1;
+
+	return power;
+}
+
+
+/* 0 marks empty slots */
+static inline uint64_t
+fingerprint(uint64_t hash)
+{
+	return hash ? hash : 1;
+}
+
+
+static bool
+shard_alloc(visited_shard_t * shard, size_t capacity)
+{
+	uint64_t * slots = calloc(capacity, sizeof(uint64_t));
+
+	if (!slots) {
+		perror("Error");
+		return false;
+	}
+
+	shard->slots = slots;
+	shard->capacity = capacity;
+
+	return true;
+}
+
+
+visited_t *
+visited_create(size_t expected, double fp_rate, int flags)
+{
+	visited_t * set = calloc(1, sizeof(visited_t));
+	size_t capacity;
+
+	if (!set) {
+		perror("Error");
+		return NULL;
+	}
+
+	if (!(set->filter = bloom_create(expected, fp_rate))) {
+		free(set);
+		return NULL;
+	}
+
+	if (flags & VISITED_APPROXIMATE)
+		return set;
+
+	if (posix_memalign((void**)&set->shards, 64, VISITED_SHARDS * sizeof(visited_shard_t))) {
+		perror("Error");
+		set->shards = NULL;
+		visited_destroy(set);
+		return NULL;
+	}
+	memset(set->shards, 0, VISITED_SHARDS * sizeof(visited_shard_t));
+
+	// room for expected urls below the maximum load of 3/4
+	capacity = round_up(expected / VISITED_SHARDS * 4 / 3 + 1);
+
+	for (int i = 0; i < VISITED_SHARDS; i++) {
+		if (!shard_alloc(&set->shards[i], capacity)) {
+			while (i--) {
+				pthread_mutex_destroy(&set->shards[i].lock);
+				free(set->shards[i].slots);
+			}
+			free(set->shards);
+			bloom_destroy(set->filter);
+			free(set);
+			return NULL;
+		}
+		pthread_mutex_init(&set->shards[i].lock, NULL);
+	}
+
+	return set;
+}
+
+
+static inline visited_shard_t *
+get_shard(visited_t * set, uint64_t hash)
+{
+	return &set->shards[hash >> (64 - SHARD_BITS)];
+}
+
+
+/* the slot holding hash, or the empty slot where it belongs */
+static inline size_t
+shard_find(visited_shard_t * shard, uint64_t hash)
+{
+	size_t mask = shard->capacity - 1, i = hash & mask;
+
+	while (shard->slots[i] && shard->slots[i] != hash)
+		i = (i + 1) & mask;
+
+	return i;
+}
+
+
+static bool
+shard_resize(visited_shard_t * shard, size_t capacity)
+{
+	visited_shard_t old = *shard;
+
+	if (!shard_alloc(shard, capacity))
+		return false;
+
+	for (size_t i = 0; i < old.capacity; i++)
+		if (old.slots[i])
+			shard->slots[shard_find(shard, old.slots[i])] = old.slots[i];
+
+	free(old.slots);
+
+	return true;
+}
+
+
+static bool
+shard_grow(visited_shard_t * shard)
+{
+	return shard_resize(shard, shard->capacity * 2);
+}
+
+
+bool
+visited_insert_if_absent(visited_t * set, uint64_t url_hash)
+{
+	uint64_t hash = fingerprint(url_hash);
+	visited_shard_t * shard;
+	bool inserted = false;
+	size_t i;
+
+	if (!set->shards) {
+		if (!bloom_add(set->filter, hash))
+			return false;
+
+		__atomic_add_fetch(&set->count, 1, __ATOMIC_RELAXED);
+		return true;
+	}
+
+	// a filter miss does not settle it, another thread may be inserting the
+	// same url, so the shard is always checked
+	bloom_add(set->filter, hash);
+
+	shard = get_shard(set, hash);
+	LOCK(shard->lock);
+
+	i = shard_find(shard, hash);
+	if (!shard->slots[i]) {
+		if ((shard->count + 1) * 4 > shard->capacity * 3) {
+			if (!shard_grow(shard))
+				goto out;
+			i = shard_find(shard, hash);
+		}
+
+		shard->slots[i] = hash;
+		shard->count++;
+		inserted = true;
+	}
+
+out:
+	UNLOCK(shard->lock);
+
+	return inserted;
+}
+
+
+bool
+visited_add_all(visited_t * set, const uint64_t * url_hashes, size_t count)
+{
+	size_t added[VISITED_SHARDS] = { 0 }, i, slot;
+	visited_shard_t * shard;
+	uint64_t hash;
+
+	if (!set->shards) {
+		for (i = 0; i < count; i++)
+			set->count += bloom_add(set->filter, fingerprint(url_hashes[i]));
+		return true;
+	}
+
+	// every shard grows once, to the size it ends up with
+	for (i = 0; i < count; i++)
+		added[fingerprint(url_hashes[i]) >> (64 - SHARD_BITS)]++;
+	for (int s = 0; s < VISITED_SHARDS; s++) {
+		shard = &set->shards[s];
+		if ((shard->count + added[s]) * 4 > shard->capacity * 3 &&
+				!shard_resize(shard, round_up((shard->count + added[s]) * 4 / 3 + 1)))
+			return false;
+	}
+
+	// a random bloom block and slot per hash, fetched a few hashes ahead
+	for (i = 0; i < count; i++) {
+		if (i + PREFETCH_DISTANCE < count) {
+			hash = fingerprint(url_hashes[i + PREFETCH_DISTANCE]);
+			bloom_prefetch(set->filter, hash);
+			shard = get_shard(set, hash);
+			__builtin_prefetch(&shard->slots[hash & (shard->capacity - 1)], 1);
+		}
+
+		hash = fingerprint(url_hashes[i]);
+		bloom_add(set->filter, hash);
+
+		shard = get_shard(set, hash);
+		slot = shard_find(shard, hash);
+		if (!shard->slots[slot]) {
+			shard->slots[slot] = hash;
+			shard->count++;
+		}
+	}
+
+	return true;
+}
+
+
+bool
+visited_contains(visited_t * set, uint64_t url_hash)
+{
+	uint64_t hash = fingerprint(url_hash);
+	visited_shard_t * shard;
+	bool found;
+
+	if (!bloom_contains(set->filter, hash))
+		return false;
+
+	if (!set->shards)
+		return true;
+
+	shard = get_shard(set, hash);
+	LOCK(shard->lock);
+	found = shard->slots[shard_find(shard, hash)] != 0;
+	UNLOCK(shard->lock);
+
+	return found;
+}
+
+
+size_t
+visited_size(visited_t * set)
+{
+	size_t size = 0;
+
+	if (!set->shards)
+		return set->count;
+
+	for (int i = 0; i < VISITED_SHARDS; i++)
+		size += set->shards[i].count;
+
+	return size;
+}
+
+
+size_t
+visited_memory(visited_t * set)
+{
+	size_t memory = sizeof(visited_t) + bloom_memory(set->filter);
+
+	if (set->shards) {
+		memory += VISITED_SHARDS * sizeof(visited_shard_t);
+		for (int i = 0; i < VISITED_SHARDS; i++)
+			memory += set->shards[i].capacity * sizeof(uint64_t);
+	}
+
+	return memory;
+}
+
+
+/*
+ * Only a fingerprint collision makes the exact set wrong: a new url matches
+ * one of the n stored fingerprints with probability n / 2^64.
+ */
+double
+visited_fp_rate(visited_t * set)
+{
+	if (!set->shards)
+		return bloom_fp_rate(set->filter);
+
+	return visited_size(set) / 18446744073709551616.0;
+}
+
+
+void
+visited_destroy(visited_t * set)
+{
+	if (set->shards) {
+		for (int i = 0; i < VISITED_SHARDS; i++) {
+			pthread_mutex_destroy(&set->shards[i].lock);
+			free(set->shards[i].slots);
+		}
+		free(set->shards);
+	}
+
+	bloom_destroy(set->filter);
+	free(set);
+}
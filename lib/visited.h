@@ -0,0 +1,91 @@
+#ifndef VISITED_H
+#define VISITED_H
+
+#include <pthread.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "bloom.h"
+
+
+#define	VISITED_SHARDS		64
+#define	VISITED_FP_RATE		0.01	/* of the filter in front of the fingerprints */
+
+/* keep only the Bloom filter, urls it mistakes for visited are never crawled */
+#define	VISITED_APPROXIMATE	(1 << 0)
+
+
+/* open addressing over fingerprints, 0 marks an empty slot */
+typedef struct visited_shard {
+	pthread_mutex_t lock;
+	size_t capacity;	/* a power of two */
+	size_t count;
+	uint64_t * slots;
+} __attribute__((aligned(64))) visited_shard_t;
+
+
+/*
+ * A set of visited urls that keeps a 64-bit fingerprint of each url instead
+ * of the url itself: 11 to 22 bytes per url depending on how full the
+ * shards are, instead of the string, a node and a malloc header. Different
+ * urls share a fingerprint with probability 2^-64, so in practice it behaves
+ * as an exact set.
+ *
+ * A Bloom filter in front answers most lookups of new urls without taking a
+ * shard lock. With VISITED_APPROXIMATE the fingerprints are not kept at all
+ * and the filter alone, at about 10 bits per url for 1%, is the set.
+ */
+typedef struct visited {
+	bloom_t * filter;
+	visited_shard_t * shards;	/* NULL if approximate */
+	size_t count;		/* urls inserted, for the approximate set */
+} visited_t;
+
+
+/* sized for expected urls, the filter for a false positive rate of fp_rate */
+visited_t *
+visited_create(size_t expected, double fp_rate, int flags);
+
+
+/*
+ * Urls are given by their 64-bit hash, which serves as the fingerprint, so
+ * it must mix every byte of the url into every bit (see hash.h). Returns
+ * true if the url was inserted, false if it was already in the set.
+ */
+bool
+visited_insert_if_absent(visited_t * set, uint64_t url_hash);
+
+
+/*
+ * Inserts count urls at once, before other threads use the set: no lock is
+ * taken and each shard grows once, to the size it ends up with. Returns
+ * false if a shard could not grow.
+ */
+bool
+visited_add_all(visited_t * set, const uint64_t * url_hashes, size_t count);
+
+
+bool
+visited_contains(visited_t * set, uint64_t url_hash);
+
+
+/* not synchronized with concurrent updates, for reporting */
+size_t
+visited_size(visited_t * set);
+
+
+size_t
+visited_memory(visited_t * set);
+
+
+/* chance that a url never inserted is reported as visited */
+double
+visited_fp_rate(visited_t * set);
+
+
+void
+visited_destroy(visited_t * set);
+
+
+#endif /* VISITED_H */
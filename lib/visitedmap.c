@@ -0,0 +1,300 @@
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/file.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "visitedmap.h"
+
+
+#define LOCK(lock)		pthread_mutex_lock(&lock);
+#define UNLOCK(lock)	pthread_mutex_unlock(&lock);
+
+#define	MAP_MAGIC		"CRAWLVS1"
+#define	HEADER_SIZE		4096	/* a page, so the levels are page aligned */
+
+
+/* 0 marks empty slots */
+static inline uint64_t
+fingerprint(uint64_t hash)
+{
+	return hash ? hash : 1;
+}
+
+
+static inline uint64_t
+level_slots(visited_map_t * map, uint32_t level)
+{
+	return map->header->slots << level;
+}
+
+
+/* levels before this one hold slots * (2^level - 1) slots */
+static inline off_t
+level_offset(visited_map_t * map, uint32_t level)
+{
+	return HEADER_SIZE + (off_t)(map->header->slots * ((1ULL << level) - 1)) * sizeof(visited_slot_t);
+}
+
+
+/* maps the levels that this or another process added to the file */
+static bool
+map_levels(visited_map_t * map)
+{
+	uint32_t levels = __atomic_load_n(&map->header->levels, __ATOMIC_ACQUIRE);
+	bool ok = true;
+	void * slots;
+
+	LOCK(map->lock);
+
+	for (uint32_t i = map->num_levels; i < levels; i++) {
+		slots = mmap(NULL, level_slots(map, i) * sizeof(visited_slot_t), PROT_READ | PROT_WRITE,
+				MAP_SHARED, map->fd, level_offset(map, i));
+		if (slots == MAP_FAILED) {
+			perror("Error");
+			ok = false;
+			break;
+		}
+
+		map->levels[i] = slots;
+		__atomic_store_n(&map->num_levels, i + 1, __ATOMIC_RELEASE);
+	}
+
+	UNLOCK(map->lock);
+
+	return ok;
+}
+
+
+visited_map_t *
+visited_map_open(const char * path)
+{
+	visited_map_t * map = calloc(1, sizeof(visited_map_t));
+	visited_map_header_t header = { MAP_MAGIC, VISITED_MAP_SLOTS, 1, 0, { 0 } };
+	struct stat st;
+
+	if (!map) {
+		perror("Error");
+		return NULL;
+	}
+
+	if ((map->fd = open(path, O_RDWR | O_CREAT, 0666)) == -1) {
+		perror(path);
+		free(map);
+		return NULL;
+	}
+
+	// two crawls that create the file at once must not both lay it out
+	flock(map->fd, LOCK_EX);
+
+	if (fstat(map->fd, &st) == -1) {
+		perror(path);
+		goto fail;
+	}
+
+	if (st.st_size == 0) {
+		st.st_size = HEADER_SIZE + VISITED_MAP_SLOTS * sizeof(visited_slot_t);
+		if (ftruncate(map->fd, st.st_size) == -1 || pwrite(map->fd, &header, sizeof(header), 0) != sizeof(header)) {
+			perror(path);
+			goto fail;
+		}
+	} else if (st.st_size < HEADER_SIZE) {
+		goto invalid;
+	}
+
+	map->header = mmap(NULL, HEADER_SIZE, PROT_READ | PROT_WRITE, MAP_SHARED, map->fd, 0);
+	if (map->header == MAP_FAILED) {
+		perror(path);
+		map->header = NULL;
+		goto fail;
+	}
+
+	if (memcmp(map->header->magic, MAP_MAGIC, sizeof(map->header->magic)) ||
+			map->header->slots == 0 || (map->header->slots & (map->header->slots - 1)) ||
+			map->header->levels == 0 || map->header->levels > VISITED_MAP_LEVELS ||
+			st.st_size < level_offset(map, map->header->levels))
+		goto invalid;
+
+	flock(map->fd, LOCK_UN);
+
+	pthread_mutex_init(&map->lock, NULL);
+	if (!map_levels(map)) {
+		visited_map_close(map);
+		return NULL;
+	}
+
+	return map;
+
+invalid:
+	fprintf(stderr, "%s is not a visited set.\n", path);
+fail:
+	if (map->header)
+		munmap(map->header, HEADER_SIZE);
+	close(map->fd);
+	free(map);
+	return NULL;
+}
+
+
+/*
+ * Adds a level once the newest one is half full, unless another thread or
+ * process did already. Returns false if the file cannot grow, and the
+ * first time it fails marks the map full.
+ */
+static bool
+grow(visited_map_t * map, uint32_t newest)
+{
+	uint32_t levels;
+	bool ok = true;
+
+	flock(map->fd, LOCK_EX);
+
+	levels = __atomic_load_n(&map->header->levels, __ATOMIC_ACQUIRE);
+	if (levels == newest + 1) {
+		if (levels == VISITED_MAP_LEVELS || ftruncate(map->fd, level_offset(map, levels + 1)) == -1) {
+			if (levels == VISITED_MAP_LEVELS)
+				errno = EFBIG;
+			if (!__atomic_exchange_n(&map->full, true, __ATOMIC_RELAXED))
+				perror("Error");
+			ok = false;
+		} else {
+			__atomic_store_n(&map->header->levels, levels + 1, __ATOMIC_RELEASE);
+		}
+	}
+
+	flock(map->fd, LOCK_UN);
+
+	return ok && map_levels(map);
+}
+
+
+/* true if the slot was fetched over max_age seconds ago and this call renewed it */
+static bool
+renew(visited_slot_t * slot, uint64_t now, uint64_t max_age)
+{
+	uint64_t time = __atomic_load_n(&slot->time, __ATOMIC_RELAXED);
+
+	if (max_age == 0 || time == 0 || now - time <= max_age)
+		return false;
+
+	return __atomic_compare_exchange_n(&slot->time, &time, now, false, __ATOMIC_RELAXED, __ATOMIC_RELAXED);
+}
+
+
+/* the slot of fp in a level, or the empty slot where it would go */
+static visited_slot_t *
+probe(visited_slot_t * slots, uint64_t mask, uint64_t fp)
+{
+	uint64_t i = fp & mask, current;
+
+	for (;; i = (i + 1) & mask) {
+		current = __atomic_load_n(&slots[i].fingerprint, __ATOMIC_ACQUIRE);
+		if (current == fp || current == 0)
+			return &slots[i];
+	}
+}
+
+
+bool
+visited_map_insert_if_absent(visited_map_t * map, uint64_t url_hash, uint64_t max_age)
+{
+	uint64_t fp = fingerprint(url_hash), now = time(NULL), expected, count;
+	uint32_t newest;
+	visited_slot_t * slot;
+
+	if (__atomic_load_n(&map->header->levels, __ATOMIC_ACQUIRE) > __atomic_load_n(&map->num_levels, __ATOMIC_ACQUIRE))
+		map_levels(map);
+	newest = __atomic_load_n(&map->num_levels, __ATOMIC_ACQUIRE) - 1;
+
+	// older levels only change in the slots they already hold
+	for (uint32_t i = 0; i < newest; i++) {
+		slot = probe(map->levels[i], level_slots(map, i) - 1, fp);
+		if (__atomic_load_n(&slot->fingerprint, __ATOMIC_ACQUIRE) == fp)
+			return renew(slot, now, max_age);
+	}
+
+	for (;;) {
+		count = __atomic_load_n(&map->header->counts[newest], __ATOMIC_RELAXED);
+		if (count >= level_slots(map, newest) / 2) {
+			// the url may have gone to the level that was the newest meanwhile
+			if (!__atomic_load_n(&map->full, __ATOMIC_RELAXED) && grow(map, newest))
+				return visited_map_insert_if_absent(map, url_hash, max_age);
+			// a file that cannot grow fills its last level up to 3/4
+			if (count >= level_slots(map, newest) / 4 * 3)
+				return false;
+		}
+
+		slot = probe(map->levels[newest], level_slots(map, newest) - 1, fp);
+		expected = 0;
+		if (__atomic_compare_exchange_n(&slot->fingerprint, &expected, fp, false, __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE)) {
+			__atomic_store_n(&slot->time, now, __ATOMIC_RELAXED);
+			__atomic_add_fetch(&map->header->counts[newest], 1, __ATOMIC_RELAXED);
+			return true;
+		}
+
+		if (expected == fp)
+			return renew(slot, now, max_age);
+		// lost the empty slot to another url, probe again
+	}
+}
+
+
+bool
+visited_map_contains(visited_map_t * map, uint64_t url_hash, uint64_t max_age)
+{
+	uint64_t fp = fingerprint(url_hash), fetched;
+	uint32_t levels;
+	visited_slot_t * slot;
+
+	if (__atomic_load_n(&map->header->levels, __ATOMIC_ACQUIRE) > __atomic_load_n(&map->num_levels, __ATOMIC_ACQUIRE))
+		map_levels(map);
+	levels = __atomic_load_n(&map->num_levels, __ATOMIC_ACQUIRE);
+
+	for (uint32_t i = levels; i-- > 0; ) {
+		slot = probe(map->levels[i], level_slots(map, i) - 1, fp);
+		if (__atomic_load_n(&slot->fingerprint, __ATOMIC_ACQUIRE) != fp)
+			continue;
+
+		// a slot still being written is as good as fetched now
+		fetched = __atomic_load_n(&slot->time, __ATOMIC_RELAXED);
+		return max_age == 0 || fetched == 0 || (uint64_t)time(NULL) - fetched <= max_age;
+	}
+
+	return false;
+}
+
+
+size_t
+visited_map_size(visited_map_t * map)
+{
+	size_t count = 0;
+
+	for (uint32_t i = 0; i < map->num_levels; i++)
+		count += __atomic_load_n(&map->header->counts[i], __ATOMIC_RELAXED);
+
+	return count;
+}
+
+
+size_t
+visited_map_memory(visited_map_t * map)
+{
+	return level_offset(map, map->num_levels);
+}
+
+
+void
+visited_map_close(visited_map_t * map)
+{
+	for (uint32_t i = 0; i < map->num_levels; i++)
+		munmap(map->levels[i], level_slots(map, i) * sizeof(visited_slot_t));
+	munmap(map->header, HEADER_SIZE);
+	close(map->fd);
+	pthread_mutex_destroy(&map->lock);
+	free(map);
+}
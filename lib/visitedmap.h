@@ -0,0 +1,94 @@
+#ifndef VISITEDMAP_H
+#define VISITEDMAP_H
+
+#include <pthread.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+
+#define	VISITED_MAP_LEVELS	32
+#define	VISITED_MAP_SLOTS	(1 << 20)	/* of the first level of a new file */
+
+
+/* a fingerprint, 0 if the slot is empty, and when the url was fetched */
+typedef struct visited_slot {
+	uint64_t fingerprint;
+	uint64_t time;			/* seconds since the epoch, 0 while it is being written */
+} visited_slot_t;
+
+
+/* the first page of the file, shared by every process that maps it */
+typedef struct visited_map_header {
+	char magic[8];
+	uint64_t slots;			/* of level 0, every level doubles it */
+	uint32_t levels;		/* in the file */
+	uint32_t unused;
+	uint64_t counts[VISITED_MAP_LEVELS];
+} visited_map_header_t;
+
+
+/*
+ * A set of fetched urls that lives in a file, so the next crawl starts
+ * from where the last one left off and several crawls at once can share
+ * it. It holds the 64-bit hash of each url (see visited.h) and the time
+ * it was fetched, so urls fetched long enough ago can be crawled again.
+ * Urls that were only queued stay out of it, so a crawl that stops early
+ * does not hide them from the crawls that follow.
+ *
+ * The file is a series of open addressing tables, each twice as large as
+ * the one before and filled up to half before the next one is added: the
+ * file is extended and the new level mapped on its own, so slots never
+ * move. Opening a file maps its levels and reads nothing, whatever its
+ * size; lookups go through the levels, newest first.
+ *
+ * Slots are claimed with a compare and swap on the shared mapping, so
+ * threads and processes insert without locks, and a flock() only orders
+ * the growth of the file. A url inserted by two of them at the moment a
+ * level is added may be claimed by both.
+ */
+typedef struct visited_map {
+	int fd;
+	visited_map_header_t * header;
+	visited_slot_t * levels[VISITED_MAP_LEVELS];
+	uint32_t num_levels;	/* mapped by this process */
+	bool full;		/* the file could not grow, this process stops trying */
+	pthread_mutex_t lock;	/* of mapping levels */
+} visited_map_t;
+
+
+/* opens path, creating it if it does not exist */
+visited_map_t *
+visited_map_open(const char * path);
+
+
+/*
+ * Returns true if the url was inserted, or if it was fetched more than
+ * max_age seconds ago and its time is renewed now. A max_age of 0 never
+ * renews a url.
+ */
+bool
+visited_map_insert_if_absent(visited_map_t * map, uint64_t url_hash, uint64_t max_age);
+
+
+/* true if the url was fetched, less than max_age seconds ago unless max_age is 0 */
+bool
+visited_map_contains(visited_map_t * map, uint64_t url_hash, uint64_t max_age);
+
+
+/* urls in the file, not synchronized */
+size_t
+visited_map_size(visited_map_t * map);
+
+
+/* bytes of the file */
+size_t
+visited_map_memory(visited_map_t * map);
+
+
+/* the file stays, the kernel writes back what is not written yet */
+void
+visited_map_close(visited_map_t * map);
+
+
+#endif /* VISITEDMAP_H */